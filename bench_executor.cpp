@@ -0,0 +1,229 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/prctl.h>
+#include "executor.hpp"
+
+// measures how long requests wait to be parsed and answered when some handlers are slow,
+// with handlers run inline on the parsing thread and on a work_stealing_executor
+//
+// usage: bench_executor [--requests=N] [--interval-us=N] [--slow-every=N] [--slow-us=N] [--workers=N]
+//
+// requests arrive at a steady rate, one every interval-us, and every slow-every-th request
+// needs slow-us of CPU to answer. inline, each slow handler delays the parsing of every request
+// arriving meanwhile; on the executor, the parsing thread hands the handler off and moves on
+
+
+using clock_type = std::chrono::steady_clock;
+
+
+struct options
+{
+  int requests = 20000;
+  double interval_us = 20;
+  int slow_every = 50;
+  double slow_us = 500;
+  unsigned workers = std::max(2u, std::thread::hardware_concurrency());
+};
+
+
+// answers "/slow" after burning slow_us of CPU, and anything else at once
+struct handler
+{
+  double slow_us;
+
+  void operator()(const hattip::full_request& request, hattip::full_response& response) const
+  {
+    if(request.rl.uri == "/slow")
+    {
+      auto until = clock_type::now() + std::chrono::duration_cast<clock_type::duration>(std::chrono::duration<double, std::micro>(slow_us));
+      while(clock_type::now() < until);
+    }
+
+    response.sl.version = {1, 1};
+    response.sl.code.number = 200;
+    hattip::assign_string(response.sl.reason, "OK");
+    response.body.assign("Hello, world!\n");
+  }
+};
+
+
+// when each request arrived, was parsed, and was answered
+struct timeline
+{
+  std::vector<clock_type::time_point> arrived;
+  std::vector<clock_type::time_point> parsed;
+  std::vector<clock_type::time_point> answered;
+  std::vector<bool> slow;
+};
+
+
+std::vector<std::string> make_requests(const options& opts)
+{
+  std::vector<std::string> result;
+  for(int i = 0; i != opts.requests; ++i)
+  {
+    std::string uri = i % opts.slow_every == opts.slow_every - 1 ? "/slow" : "/fast";
+    result.push_back("GET " + uri + " HTTP/1.1\r\nHost: example.com\r\nAccept: */*\r\n\r\n");
+  }
+
+  return result;
+}
+
+
+// waits for each request to arrive, parses it, and passes it to dispatch along with its index
+template<class Dispatch>
+timeline drive(const options& opts, const std::vector<std::string>& requests, Dispatch dispatch)
+{
+  timeline t;
+  t.arrived.resize(requests.size());
+  t.parsed.resize(requests.size());
+  t.answered.resize(requests.size());
+
+  auto interval = std::chrono::duration_cast<clock_type::duration>(std::chrono::duration<double, std::micro>(opts.interval_us));
+  auto start = clock_type::now();
+
+  for(std::size_t i = 0; i != requests.size(); ++i)
+  {
+    // a request that arrived while we were busy is parsed late
+    t.arrived[i] = start + i * interval;
+    std::this_thread::sleep_until(t.arrived[i]);
+
+    hattip::full_request request;
+    hattip::lexer lex{std::span<const char>{requests[i]}};
+    lex >> request;
+
+    t.parsed[i] = clock_type::now();
+    t.slow.push_back(request.rl.uri == "/slow");
+
+    dispatch(i, std::move(request), t);
+  }
+
+  return t;
+}
+
+
+void report(const char* name, const timeline& t)
+{
+  std::vector<double> parse_delays;
+  std::vector<double> fast_latencies;
+
+  for(std::size_t i = 0; i != t.arrived.size(); ++i)
+  {
+    parse_delays.push_back(std::chrono::duration<double, std::micro>(t.parsed[i] - t.arrived[i]).count());
+    if(not t.slow[i])
+    {
+      fast_latencies.push_back(std::chrono::duration<double, std::micro>(t.answered[i] - t.arrived[i]).count());
+    }
+  }
+
+  auto percentile = [](std::vector<double>& v, double p)
+  {
+    std::sort(v.begin(), v.end());
+    return v[std::min(v.size() - 1, std::size_t(p * v.size()))];
+  };
+
+  std::printf("%-20s %14.1f %14.1f %14.1f %14.1f\n", name,
+              percentile(parse_delays, 0.5), percentile(parse_delays, 0.99),
+              percentile(fast_latencies, 0.5), percentile(fast_latencies, 0.99));
+}
+
+
+int main(int argc, char** argv)
+{
+  options opts;
+
+  for(int i = 1; i != argc; ++i)
+  {
+    std::string arg = argv[i];
+
+    if(arg.starts_with("--requests="))
+    {
+      opts.requests = std::atoi(arg.c_str() + 11);
+    }
+    else if(arg.starts_with("--interval-us="))
+    {
+      opts.interval_us = std::atof(arg.c_str() + 14);
+    }
+    else if(arg.starts_with("--slow-every="))
+    {
+      opts.slow_every = std::max(1, std::atoi(arg.c_str() + 13));
+    }
+    else if(arg.starts_with("--slow-us="))
+    {
+      opts.slow_us = std::atof(arg.c_str() + 10);
+    }
+    else if(arg.starts_with("--workers="))
+    {
+      opts.workers = std::max(1, std::atoi(arg.c_str() + 10));
+    }
+    else
+    {
+      std::fprintf(stderr, "usage: bench_executor [--requests=N] [--interval-us=N] [--slow-every=N] [--slow-us=N] [--workers=N]\n");
+      return 1;
+    }
+  }
+
+  // wake up for each arrival on time, rather than up to the default 50us late
+  prctl(PR_SET_TIMERSLACK, 1);
+
+  std::vector<std::string> requests = make_requests(opts);
+  handler handle{opts.slow_us};
+
+  std::printf("%-20s %14s %14s %14s %14s\n", "handlers", "parse p50 us", "parse p99 us", "fast p50 us", "fast p99 us");
+
+  {
+    hattip::full_response response;
+    std::string output;
+
+    timeline t = drive(opts, requests, [&](std::size_t i, hattip::full_request request, timeline& t)
+    {
+      response.reset();
+      handle(request, response);
+
+      output.resize(hattip::serialized_size(response));
+      hattip::serialize_into(output.data(), response);
+      t.answered[i] = clock_type::now();
+    });
+
+    report("inline", t);
+  }
+
+  {
+    hattip::work_stealing_executor executor{opts.workers};
+    std::atomic<std::size_t> num_answered{0};
+
+    timeline t = drive(opts, requests, [&](std::size_t i, hattip::full_request request, timeline& t)
+    {
+      // the vectors keep their storage when drive() moves the timeline out
+      clock_type::time_point* answered = &t.answered[i];
+
+      executor.submit(std::move(request), handle, [&, answered](const hattip::full_response& response)
+      {
+        // each worker serializes into its own buffer
+        thread_local std::string output;
+        output.resize(hattip::serialized_size(response));
+        hattip::serialize_into(output.data(), response);
+
+        *answered = clock_type::now();
+        num_answered.fetch_add(1, std::memory_order_release);
+      });
+    });
+
+    while(num_answered.load(std::memory_order_acquire) != requests.size())
+    {
+      std::this_thread::yield();
+    }
+
+    std::string name = "executor x" + std::to_string(executor.size());
+    report(name.c_str(), t);
+  }
+
+  return 0;
+}
+
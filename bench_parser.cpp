@@ -0,0 +1,491 @@
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "corpus.hpp"
+#include "count_allocations.hpp"
+#include "parser.hpp"
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// benchmarks the lexer and the grammar's productions, reporting for each:
+//
+// * ns/msg: nanoseconds per message (or per token, for the lexer)
+// * MB/s:   megabytes of input per second
+// * cyc/B:  timestamp counter cycles per byte of input, or 0 where there is no timestamp counter
+// * allocs/msg: allocations per message
+//
+// usage: bench_parser [--corpus=FILE] [--counters] [substring of benchmark names to run]
+//
+// with a corpus file, e.g. from gen_corpus, parsing the whole corpus is benchmarked as well
+//
+// with --counters, hardware performance counters are reported per message and per byte too
+
+
+// keeps the compiler from discarding a result we never use
+template<class T>
+inline void do_not_optimize(const T& value)
+{
+  asm volatile("" : : "r,m"(value) : "memory");
+}
+
+
+inline std::uint64_t timestamp_counter()
+{
+#if defined(__SSE2__) or defined(__AVX2__)
+  return __rdtsc();
+#else
+  return 0;
+#endif
+}
+
+
+// hardware performance counters of this thread, read with perf_event_open
+//
+// a counter which cannot be opened, e.g. without a PMU in a VM, with a restrictive
+// kernel.perf_event_paranoid, or on other platforms, is simply not reported
+struct perf_counters
+{
+  static constexpr std::size_t size = 5;
+
+  using values = std::array<double, size>;
+
+  static constexpr const char* names[size] = {"cycles", "instructions", "branch-misses", "L1d-misses", "LLC-misses"};
+
+  perf_counters()
+  {
+    fds_.fill(-1);
+
+#if defined(__linux__)
+    auto cache_miss = [](std::uint64_t cache)
+    {
+      return cache | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    };
+
+    std::pair<std::uint32_t, std::uint64_t> events[size] = {
+      {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+      {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+      {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+      {PERF_TYPE_HW_CACHE, cache_miss(PERF_COUNT_HW_CACHE_L1D)},
+      {PERF_TYPE_HW_CACHE, cache_miss(PERF_COUNT_HW_CACHE_LL)}
+    };
+
+    for(std::size_t i = 0; i != size; ++i)
+    {
+      perf_event_attr attr{};
+      attr.size = sizeof(attr);
+      attr.type = events[i].first;
+      attr.config = events[i].second;
+      attr.exclude_kernel = 1;
+      attr.exclude_hv = 1;
+
+      // when there are more counters than the PMU has, the kernel multiplexes them,
+      // so read how long each was actually counting in order to scale it
+      attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+      fds_[i] = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+    }
+#endif
+  }
+
+  ~perf_counters()
+  {
+#if defined(__linux__)
+    for(int fd : fds_)
+    {
+      if(fd != -1) close(fd);
+    }
+#endif
+  }
+
+  perf_counters(const perf_counters&) = delete;
+
+  bool is_available(std::size_t i) const
+  {
+    return fds_[i] != -1;
+  }
+
+  bool any_available() const
+  {
+    for(std::size_t i = 0; i != size; ++i)
+    {
+      if(is_available(i)) return true;
+    }
+
+    return false;
+  }
+
+  // the current count of each available counter
+  values read() const
+  {
+    values result{};
+
+#if defined(__linux__)
+    for(std::size_t i = 0; i != size; ++i)
+    {
+      std::uint64_t value[3] = {};
+      if(is_available(i) and ::read(fds_[i], value, sizeof(value)) == sizeof(value) and value[2] != 0)
+      {
+        result[i] = static_cast<double>(value[0]) * value[1] / value[2];
+      }
+    }
+#endif
+
+    return result;
+  }
+
+  private:
+    std::array<int, size> fds_;
+};
+
+
+struct benchmark_result
+{
+  double seconds;
+  double cycles;
+  std::size_t iterations;
+  perf_counters::values counts;
+  std::size_t allocations;
+};
+
+
+// runs body until the fastest of several trials is measured, each long enough to time reliably
+//
+// when counters is not null, their counts during the fastest trial are measured as well
+template<class Function>
+benchmark_result measure(Function body, const perf_counters* counters = nullptr)
+{
+  using clock = std::chrono::steady_clock;
+
+  // warm up, then find an iteration count which takes at least 50ms
+  body();
+
+  std::size_t iterations = 1;
+  for(;;)
+  {
+    auto start = clock::now();
+    for(std::size_t i = 0; i != iterations; ++i)
+    {
+      body();
+    }
+
+    if(clock::now() - start >= std::chrono::milliseconds(50))
+    {
+      break;
+    }
+
+    iterations *= 2;
+  }
+
+  benchmark_result best{1e300, 0, iterations, {}, 0};
+  for(int trial = 0; trial != 5; ++trial)
+  {
+    perf_counters::values start_counts = counters ? counters->read() : perf_counters::values{};
+    allocation_counter allocations;
+    auto start = clock::now();
+    std::uint64_t start_cycles = timestamp_counter();
+
+    for(std::size_t i = 0; i != iterations; ++i)
+    {
+      body();
+    }
+
+    std::uint64_t cycles = timestamp_counter() - start_cycles;
+    double seconds = std::chrono::duration<double>(clock::now() - start).count();
+    perf_counters::values counts = counters ? counters->read() : perf_counters::values{};
+
+    if(seconds < best.seconds)
+    {
+      for(std::size_t i = 0; i != counts.size(); ++i)
+      {
+        counts[i] -= start_counts[i];
+      }
+
+      best = benchmark_result{seconds, static_cast<double>(cycles), iterations, counts, allocations.elapsed().count};
+    }
+  }
+
+  return best;
+}
+
+
+struct benchmark_suite
+{
+  std::string filter;
+  std::unique_ptr<perf_counters> counters;
+
+  // runs body, which parses num_messages messages from num_bytes characters of input,
+  // when name contains the filter
+  template<class Function>
+  void run(const std::string& name, std::size_t num_bytes, std::size_t num_messages, Function body)
+  {
+    if(name.find(filter) == std::string::npos)
+    {
+      return;
+    }
+
+    benchmark_result result = measure(body, counters.get());
+
+    double bytes = static_cast<double>(num_bytes) * result.iterations;
+    double messages = static_cast<double>(num_messages) * result.iterations;
+
+    std::printf("%-40s %12.1f %12.1f %10.3f %10.2f\n",
+      name.c_str(),
+      1e9 * result.seconds / messages,
+      bytes / result.seconds / 1e6,
+      result.cycles / bytes,
+      result.allocations / messages
+    );
+
+    if(counters and counters->any_available())
+    {
+      std::printf("   ");
+
+      for(std::size_t i = 0; i != perf_counters::size; ++i)
+      {
+        if(counters->is_available(i))
+        {
+          std::printf(" %s %.1f/msg %.3f/B", perf_counters::names[i], result.counts[i] / messages, result.counts[i] / bytes);
+        }
+      }
+
+      std::printf("\n");
+    }
+  }
+};
+
+
+std::string repeat(const std::string& s, std::size_t n)
+{
+  std::string result;
+  result.reserve(s.size() * n);
+
+  for(std::size_t i = 0; i != n; ++i)
+  {
+    result += s;
+  }
+
+  return result;
+}
+
+
+std::string make_headers(std::size_t num_headers)
+{
+  static const char* names[] = {"Host", "User-Agent", "Accept", "Accept-Encoding", "Cookie", "X-Request-Id", "Cache-Control"};
+
+  std::string result;
+  for(std::size_t i = 0; i != num_headers; ++i)
+  {
+    result += names[i % std::size(names)];
+    result += ": value-";
+    result += std::to_string(i);
+    result += "-abcdefghijklmnopqrstuvwxyz\r\n";
+  }
+
+  return result + "\r\n";
+}
+
+
+// parses input into a reused Message, as a server would on a keep-alive connection
+template<class Message>
+void bench_parse(benchmark_suite& suite, const std::string& name, const std::string& input)
+{
+  Message msg;
+
+  suite.run(name, input.size(), 1, [&]
+  {
+    hattip::lexer lex{std::span<const char>{input}};
+    msg.reset();
+    lex >> msg;
+    do_not_optimize(msg);
+  });
+}
+
+
+// lexes every token of input, which contains num_tokens tokens
+void bench_lexer(benchmark_suite& suite, const std::string& name, const std::string& input, std::size_t num_tokens)
+{
+  suite.run(name, input.size(), num_tokens, [&]
+  {
+    hattip::lexer lex{std::span<const char>{input}};
+    while(not lex.peek().empty())
+    {
+      lex.next();
+    }
+    do_not_optimize(lex.position_);
+  });
+}
+
+
+// parses every message of corpus into a reused Message
+template<class Message>
+void bench_corpus(benchmark_suite& suite, const std::string& name, const std::vector<std::string>& corpus)
+{
+  std::size_t num_bytes = 0;
+  for(const std::string& message : corpus)
+  {
+    num_bytes += message.size();
+  }
+
+  Message msg;
+
+  suite.run(name, num_bytes, corpus.size(), [&]
+  {
+    for(const std::string& message : corpus)
+    {
+      hattip::lexer lex{std::span<const char>{message}};
+      msg.reset();
+      lex >> msg;
+      do_not_optimize(msg);
+    }
+  });
+}
+
+
+template<class Message>
+void bench_serialize(benchmark_suite& suite, const std::string& name, const std::string& input)
+{
+  Message msg;
+  hattip::lexer lex{std::span<const char>{input}};
+  lex >> msg;
+
+  std::ostringstream os;
+
+  suite.run(name, input.size(), 1, [&]
+  {
+    os.seekp(0);
+    os << msg;
+    do_not_optimize(os);
+  });
+}
+
+
+// gathers the pieces of the message parsed from input for writev()
+template<class Message>
+void bench_gather(benchmark_suite& suite, const std::string& name, const std::string& input)
+{
+  Message msg;
+  hattip::lexer lex{std::span<const char>{input}};
+  lex >> msg;
+
+  hattip::iovec_list iov;
+
+  suite.run(name, input.size(), 1, [&]
+  {
+    iov.clear();
+    serialize(iov, msg);
+    do_not_optimize(iov);
+  });
+}
+
+
+// serializes the message parsed from input into a reused buffer of exactly its size
+template<class Message>
+void bench_serialize_into(benchmark_suite& suite, const std::string& name, const std::string& input)
+{
+  Message msg;
+  hattip::lexer lex{std::span<const char>{input}};
+  lex >> msg;
+
+  std::string buffer;
+
+  suite.run(name, input.size(), 1, [&]
+  {
+    buffer.resize(hattip::serialized_size(msg));
+    hattip::serialize_into(buffer.data(), msg);
+    do_not_optimize(buffer);
+  });
+}
+
+
+int main(int argc, char** argv)
+{
+  benchmark_suite suite;
+  std::vector<std::string> corpus;
+
+  for(int i = 1; i != argc; ++i)
+  {
+    std::string arg = argv[i];
+
+    if(arg.starts_with("--corpus="))
+    {
+      std::ifstream file{arg.substr(9), std::ios::binary};
+      corpus = hattip::corpus::read(file);
+    }
+    else if(arg == "--counters")
+    {
+      suite.counters = std::make_unique<perf_counters>();
+
+      if(not suite.counters->any_available())
+      {
+        std::fprintf(stderr, "bench_parser: hardware performance counters are unavailable; reporting timings only\n");
+      }
+    }
+    else
+    {
+      suite.filter = arg;
+    }
+  }
+
+  std::printf("%-40s %12s %12s %10s %10s\n", "benchmark", "ns/msg", "MB/s", "cyc/B", "allocs/msg");
+
+  // each lexer benchmark's input holds 4096 tokens of a single class,
+  // except that adjacent words or numbers would lex as one token, so they alternate with spaces
+  bench_lexer(suite, "lexer::next/word+space", repeat("abcdefg ", 4096), 8192);
+  bench_lexer(suite, "lexer::next/number+space", repeat("1234567 ", 4096), 8192);
+  bench_lexer(suite, "lexer::next/tspecial", repeat(";", 4096), 4096);
+  bench_lexer(suite, "lexer::next/space", repeat(" ", 4096), 4096);
+  bench_lexer(suite, "lexer::next/crlf", repeat("\r\n", 2048), 4096);
+  bench_lexer(suite, "lexer::next/other", repeat("-", 4096), 4096);
+
+  std::string request_line = "GET /search?q=hattip&lang=en HTTP/1.1\r\n";
+  bench_parse<hattip::request_line>(suite, "request_line", request_line);
+  bench_parse<hattip::request_line_view>(suite, "request_line_view", request_line);
+
+  for(std::size_t num_headers : {5, 20, 100})
+  {
+    std::string headers = make_headers(num_headers);
+    bench_parse<hattip::http_headers>(suite, "http_headers/" + std::to_string(num_headers), headers);
+    bench_parse<hattip::http_headers_view>(suite, "http_headers_view/" + std::to_string(num_headers), headers);
+  }
+
+  std::string small_body(64, 'x');
+  std::string small_request = "POST /api/items HTTP/1.1\r\n" + make_headers(8).insert(0, "Content-Length: 64\r\n") + small_body;
+  bench_parse<hattip::full_request>(suite, "full_request/small", small_request);
+  bench_parse<hattip::full_request_view>(suite, "full_request_view/small", small_request);
+
+  std::string large_body(4 << 20, 'x');
+  std::string large_request = "POST /upload HTTP/1.1\r\nContent-Length: " + std::to_string(large_body.size()) + "\r\n\r\n" + large_body;
+  bench_parse<hattip::full_request>(suite, "full_request/4MB", large_request);
+  bench_parse<hattip::full_request_view>(suite, "full_request_view/4MB", large_request);
+
+  std::string response = "HTTP/1.1 200 OK\r\n" + make_headers(8).insert(0, "Content-Length: 64\r\n") + small_body;
+  bench_parse<hattip::full_response>(suite, "full_response/small", response);
+  bench_parse<hattip::full_response_view>(suite, "full_response_view/small", response);
+  bench_parse<hattip::message>(suite, "message/small", small_request);
+
+  bench_serialize<hattip::full_request>(suite, "serialize/full_request/small", small_request);
+  bench_serialize<hattip::full_response>(suite, "serialize/full_response/small", response);
+  bench_serialize<hattip::full_request>(suite, "serialize/full_request/4MB", large_request);
+  bench_serialize_into<hattip::full_request>(suite, "serialize_into/full_request/small", small_request);
+  bench_serialize_into<hattip::full_response>(suite, "serialize_into/full_response/small", response);
+  bench_serialize_into<hattip::full_request>(suite, "serialize_into/full_request/4MB", large_request);
+  bench_gather<hattip::full_request>(suite, "iovec_list/full_request/small", small_request);
+  bench_gather<hattip::full_response>(suite, "iovec_list/full_response/small", response);
+  bench_gather<hattip::full_request>(suite, "iovec_list/full_request/4MB", large_request);
+
+  if(not corpus.empty())
+  {
+    bench_corpus<hattip::message>(suite, "corpus/message", corpus);
+    bench_corpus<hattip::message_view>(suite, "corpus/message_view", corpus);
+  }
+
+  return 0;
+}
@@ -0,0 +1,251 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <arpa/inet.h>
+#include "server.hpp"
+#include "uring_server.hpp"
+
+// benchmarks each server against a local closed-loop load generator, reporting requests/sec
+// and latency percentiles
+//
+// usage: bench_server [--connections=N] [--threads=N] [--seconds=N] [--shards=N] [epoll|uring]
+//
+// each client thread drives its share of the connections with its own epoll loop, sending
+// each connection's next request as soon as the response to its last one arrives. the server
+// runs as a sharded_server with one shard (by default) or more in the same process, so the
+// client threads compete with its shards for cores
+
+
+using clock_type = std::chrono::steady_clock;
+
+
+struct options
+{
+  int connections = 64;
+  int threads = 2;
+  double seconds = 2;
+  unsigned shards = 1;
+};
+
+
+const std::string request =
+  "GET /index.html HTTP/1.1\r\n"
+  "Host: localhost\r\n"
+  "User-Agent: bench_server\r\n"
+  "Accept: text/html\r\n"
+  "\r\n";
+
+
+void hello(const hattip::full_request&, hattip::full_response& response)
+{
+  hattip::http_header& content_type = response.headers.emplace_back();
+  content_type.set_name("Content-Type");
+  content_type.value = "text/plain";
+
+  response.body.assign("Hello, world!\n");
+}
+
+
+struct client_connection
+{
+  int fd;
+  hattip::response_parser parser;
+  clock_type::time_point sent_at;
+};
+
+
+int connect_to(std::uint16_t port)
+{
+  int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+  sockaddr_in address{};
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  address.sin_port = htons(port);
+
+  if(connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == -1)
+  {
+    hattip::throw_system_error("connect");
+  }
+
+  int one = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+  return fd;
+}
+
+
+// drives num_connections connections until end, returning the latency in nanoseconds of each
+// request sent after measure_from
+std::vector<std::uint32_t> generate_load(std::uint16_t port, int num_connections, clock_type::time_point measure_from, clock_type::time_point end)
+{
+  int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  std::vector<std::unique_ptr<client_connection>> connections;
+  std::vector<std::uint32_t> latencies;
+
+  auto send_request = [](client_connection& conn)
+  {
+    conn.sent_at = clock_type::now();
+    if(send(conn.fd, request.data(), request.size(), MSG_NOSIGNAL) != ssize_t(request.size()))
+    {
+      hattip::throw_system_error("send");
+    }
+  };
+
+  for(int i = 0; i != num_connections; ++i)
+  {
+    auto& conn = *connections.emplace_back(std::make_unique<client_connection>());
+    conn.fd = connect_to(port);
+    conn.parser.set_unframed_body(hattip::unframed_body::http_1_1);
+
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.ptr = &conn;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, conn.fd, &event);
+
+    send_request(conn);
+  }
+
+  std::vector<epoll_event> events(num_connections);
+  std::vector<char> buffer(64 * 1024);
+
+  while(clock_type::now() < end)
+  {
+    int num_events = epoll_wait(epoll_fd, events.data(), events.size(), 10);
+
+    for(int i = 0; i < num_events; ++i)
+    {
+      client_connection& conn = *static_cast<client_connection*>(events[i].data.ptr);
+
+      ssize_t n = read(conn.fd, buffer.data(), buffer.size());
+      if(n <= 0)
+      {
+        hattip::throw_system_error("read");
+      }
+
+      hattip::parse_status status = conn.parser.feed(std::span<const char>{buffer.data(), std::size_t(n)});
+      if(status == hattip::parse_status::done)
+      {
+        auto now = clock_type::now();
+        if(conn.sent_at >= measure_from)
+        {
+          latencies.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(now - conn.sent_at).count());
+        }
+
+        conn.parser.next();
+        send_request(conn);
+      }
+      else if(status == hattip::parse_status::error)
+      {
+        std::fprintf(stderr, "bench_server: malformed response\n");
+        std::exit(1);
+      }
+    }
+  }
+
+  for(auto& conn : connections)
+  {
+    close(conn->fd);
+  }
+  close(epoll_fd);
+
+  return latencies;
+}
+
+
+template<class Server>
+void bench(const char* name, const options& opts)
+{
+  hattip::sharded_server<Server> server{0, hello, opts.shards};
+  std::uint16_t port = server.port();
+  std::thread server_thread{[&]{ server.run(); }};
+
+  // the first fifth of the run warms up the connections, caches, and allocations
+  auto start = clock_type::now();
+  auto measure_from = start + std::chrono::duration_cast<clock_type::duration>(std::chrono::duration<double>(opts.seconds / 5));
+  auto end = measure_from + std::chrono::duration_cast<clock_type::duration>(std::chrono::duration<double>(opts.seconds));
+
+  std::vector<std::vector<std::uint32_t>> results(opts.threads);
+  std::vector<std::thread> clients;
+  for(int t = 0; t != opts.threads; ++t)
+  {
+    int share = opts.connections / opts.threads + (t < opts.connections % opts.threads);
+    clients.emplace_back([&, t, share]{ results[t] = generate_load(port, share, measure_from, end); });
+  }
+
+  for(auto& client : clients)
+  {
+    client.join();
+  }
+
+  server.stop();
+  server_thread.join();
+
+  std::vector<std::uint32_t> latencies;
+  for(auto& result : results)
+  {
+    latencies.insert(latencies.end(), result.begin(), result.end());
+  }
+  std::sort(latencies.begin(), latencies.end());
+
+  auto percentile = [&](double p)
+  {
+    return latencies.empty() ? 0.0 : 1e-3 * latencies[std::min(latencies.size() - 1, std::size_t(p * latencies.size()))];
+  };
+
+  std::string label = std::string{name} + " x" + std::to_string(opts.shards);
+  std::printf("%-20s %12.0f %12.1f %12.1f %12.1f\n", label.c_str(), latencies.size() / opts.seconds, percentile(0.5), percentile(0.99), percentile(0.999));
+}
+
+
+int main(int argc, char** argv)
+{
+  options opts;
+  std::string filter;
+
+  for(int i = 1; i != argc; ++i)
+  {
+    std::string arg = argv[i];
+
+    if(arg.starts_with("--connections="))
+    {
+      opts.connections = std::atoi(arg.c_str() + 14);
+    }
+    else if(arg.starts_with("--threads="))
+    {
+      opts.threads = std::atoi(arg.c_str() + 10);
+    }
+    else if(arg.starts_with("--seconds="))
+    {
+      opts.seconds = std::atof(arg.c_str() + 10);
+    }
+    else if(arg.starts_with("--shards="))
+    {
+      opts.shards = std::max(1, std::atoi(arg.c_str() + 9));
+    }
+    else
+    {
+      filter = arg;
+    }
+  }
+
+  std::printf("%-20s %12s %12s %12s %12s\n", "server x shards", "requests/s", "p50 us", "p99 us", "p99.9 us");
+
+  if(std::string_view{"epoll_server"}.find(filter) != std::string_view::npos)
+  {
+    bench<hattip::epoll_server>("epoll_server", opts);
+  }
+
+  if(std::string_view{"uring_server"}.find(filter) != std::string_view::npos)
+  {
+    bench<hattip::uring_server>("uring_server", opts);
+  }
+
+  return 0;
+}
+
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <istream>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// a corpus is a sequence of messages stored in a single file, as written by gen_corpus.cpp
+//
+// Corpus := "hattip-corpus" LF *( Entry )
+// Entry  := 1*DIGIT LF <that many characters of message> LF
+//
+// the explicit length of each entry lets messages contain any characters, including
+// Entity-Bodies which extend to the end of the message
+namespace hattip::corpus
+{
+
+
+inline void write_header(std::ostream& os)
+{
+  os << "hattip-corpus\n";
+}
+
+
+inline void write_entry(std::ostream& os, const std::string& message)
+{
+  os << message.size() << '\n' << message << '\n';
+}
+
+
+inline std::vector<std::string> read(std::istream& is)
+{
+  std::string magic;
+  if(not std::getline(is, magic) or magic != "hattip-corpus")
+  {
+    throw std::runtime_error{"corpus: Expected \"hattip-corpus\""};
+  }
+
+  std::vector<std::string> result;
+
+  std::size_t size = 0;
+  while(is >> size)
+  {
+    if(is.get() != '\n')
+    {
+      throw std::runtime_error{"corpus: Expected <LF> after entry size"};
+    }
+
+    std::string message(size, '\0');
+    if(not is.read(message.data(), size) or is.get() != '\n')
+    {
+      throw std::runtime_error{"corpus: Unexpected end of entry"};
+    }
+
+    result.push_back(std::move(message));
+  }
+
+  if(not is.eof())
+  {
+    throw std::runtime_error{"corpus: Expected entry size"};
+  }
+
+  return result;
+}
+
+
+} // end hattip::corpus
+
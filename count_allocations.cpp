@@ -0,0 +1,33 @@
+#include <cstdlib>
+#include <new>
+#include "count_allocations.hpp"
+
+// replaces the global operator new and operator delete in order to count every allocation
+
+
+std::atomic<std::size_t> num_allocations{0};
+std::atomic<std::size_t> num_bytes_allocated{0};
+
+
+void* operator new(std::size_t n)
+{
+  num_allocations.fetch_add(1, std::memory_order_relaxed);
+  num_bytes_allocated.fetch_add(n, std::memory_order_relaxed);
+
+  if(void* result = std::malloc(n == 0 ? 1 : n))
+  {
+    return result;
+  }
+
+  throw std::bad_alloc{};
+}
+
+void operator delete(void* ptr) noexcept
+{
+  std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept
+{
+  std::free(ptr);
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+
+// counts every allocation through the global operator new, which count_allocations.cpp replaces
+//
+// a program including this header must be linked with count_allocations.cpp, whose replacements
+// live in their own translation unit so that the compiler never sees operator new's malloc() and
+// operator delete's free() together, and pairs them itself
+
+
+extern std::atomic<std::size_t> num_allocations;
+extern std::atomic<std::size_t> num_bytes_allocated;
+
+
+struct allocation_stats
+{
+  std::size_t count;
+  std::size_t bytes;
+};
+
+
+// counts the allocations made since it was constructed
+struct allocation_counter
+{
+  allocation_counter()
+    : count_{num_allocations.load()}, bytes_{num_bytes_allocated.load()}
+  {}
+
+  allocation_stats elapsed() const
+  {
+    return {num_allocations.load() - count_, num_bytes_allocated.load() - bytes_};
+  }
+
+  private:
+    std::size_t count_;
+    std::size_t bytes_;
+};
@@ -0,0 +1,439 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <thread>
+#include <vector>
+#include "parser.hpp"
+
+namespace hattip
+{
+
+
+// chase_lev_deque is the work-stealing deque of Chase and Lev ("Dynamic Circular Work-Stealing
+// Deque", 2005), with the memory orderings of Lê et al. ("Correct and Efficient Work-Stealing
+// for Weak Memory Models", 2013)
+//
+// its owner pushes and pops at the bottom without contention, while any other thread may steal
+// from the top. T must be trivially copyable, e.g. a pointer
+template<class T>
+struct chase_lev_deque
+{
+  // capacity must be a power of two; the deque grows as needed
+  explicit chase_lev_deque(std::size_t capacity = 1024)
+    : top_{0}, bottom_{0}
+  {
+    arrays_.push_back(std::make_unique<array>(capacity));
+    array_.store(arrays_.back().get(), std::memory_order_relaxed);
+  }
+
+  chase_lev_deque(const chase_lev_deque&) = delete;
+
+  // pushes x onto the bottom; only the owner may push
+  void push(T x)
+  {
+    std::int64_t b = bottom_.load(std::memory_order_relaxed);
+    std::int64_t t = top_.load(std::memory_order_acquire);
+    array* a = array_.load(std::memory_order_relaxed);
+
+    if(b - t > std::int64_t(a->capacity()) - 1)
+    {
+      a = grow(a, t, b);
+    }
+
+    // a release store rather than Lê et al.'s release fence and relaxed store, which is
+    // equivalent here, and which ThreadSanitizer, blind to fences, understands
+    a->put(b, x);
+    bottom_.store(b + 1, std::memory_order_release);
+  }
+
+  // pops the most recently pushed element from the bottom; only the owner may pop
+  std::optional<T> pop()
+  {
+    std::int64_t b = bottom_.load(std::memory_order_relaxed) - 1;
+    array* a = array_.load(std::memory_order_relaxed);
+    bottom_.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    std::int64_t t = top_.load(std::memory_order_relaxed);
+
+    std::optional<T> result;
+
+    if(t <= b)
+    {
+      result = a->get(b);
+
+      if(t == b)
+      {
+        // the last element, which a thief may be taking too
+        if(not top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+        {
+          result.reset();
+        }
+
+        bottom_.store(b + 1, std::memory_order_relaxed);
+      }
+    }
+    else
+    {
+      bottom_.store(b + 1, std::memory_order_relaxed);
+    }
+
+    return result;
+  }
+
+  // steals the least recently pushed element from the top; any thread may steal
+  //
+  // returns nothing when the deque is empty, or when another thread took the element first
+  std::optional<T> steal()
+  {
+    std::int64_t t = top_.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    std::int64_t b = bottom_.load(std::memory_order_acquire);
+
+    if(t < b)
+    {
+      array* a = array_.load(std::memory_order_acquire);
+      T x = a->get(t);
+
+      if(top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+      {
+        return x;
+      }
+    }
+
+    return std::nullopt;
+  }
+
+  // whether the deque appeared empty at some point during the call
+  bool empty() const
+  {
+    return bottom_.load(std::memory_order_relaxed) <= top_.load(std::memory_order_relaxed);
+  }
+
+  private:
+    struct array
+    {
+      explicit array(std::size_t capacity)
+        : mask_{capacity - 1},
+          elements_{std::make_unique<std::atomic<T>[]>(capacity)}
+      {}
+
+      std::size_t capacity() const
+      {
+        return mask_ + 1;
+      }
+
+      T get(std::int64_t i) const
+      {
+        return elements_[i & mask_].load(std::memory_order_relaxed);
+      }
+
+      void put(std::int64_t i, T x)
+      {
+        elements_[i & mask_].store(x, std::memory_order_relaxed);
+      }
+
+      std::size_t mask_;
+      std::unique_ptr<std::atomic<T>[]> elements_;
+    };
+
+    array* grow(array* a, std::int64_t t, std::int64_t b)
+    {
+      arrays_.push_back(std::make_unique<array>(2 * a->capacity()));
+      array* bigger = arrays_.back().get();
+
+      for(std::int64_t i = t; i != b; ++i)
+      {
+        bigger->put(i, a->get(i));
+      }
+
+      // thieves may still be reading the smaller array, which is kept until the deque is destroyed
+      array_.store(bigger, std::memory_order_release);
+      return bigger;
+    }
+
+    alignas(64) std::atomic<std::int64_t> top_;
+    alignas(64) std::atomic<std::int64_t> bottom_;
+    std::atomic<array*> array_;
+    std::vector<std::unique_ptr<array>> arrays_;
+};
+
+
+// work_stealing_executor runs tasks on a pool of worker threads, each with a chase_lev_deque
+//
+// a task submitted from a worker goes onto that worker's own deque, which it pops newest first,
+// while idle workers steal the oldest tasks of busy ones. tasks submitted from any other thread,
+// e.g. an event loop parsing requests, go through a shared queue, from which a worker out of
+// tasks moves a batch onto its own deque, for idle workers to steal like any other. a handler
+// that runs long thus occupies one worker, while the others take over the tasks queued behind it
+struct work_stealing_executor
+{
+  explicit work_stealing_executor(unsigned num_workers = std::thread::hardware_concurrency())
+  {
+    num_workers = std::max(1u, num_workers);
+
+    for(unsigned i = 0; i != num_workers; ++i)
+    {
+      workers_.push_back(std::make_unique<worker>());
+    }
+
+    for(unsigned i = 0; i != num_workers; ++i)
+    {
+      workers_[i]->thread = std::thread{[this, i]{ work(i); }};
+    }
+  }
+
+  // runs every task submitted so far, then joins the workers
+  ~work_stealing_executor()
+  {
+    stopping_.store(true);
+    wake_all();
+
+    for(auto& w : workers_)
+    {
+      w->thread.join();
+    }
+  }
+
+  work_stealing_executor(const work_stealing_executor&) = delete;
+
+  std::size_t size() const
+  {
+    return workers_.size();
+  }
+
+  // the number of tasks workers have stolen from each other so far
+  std::size_t steals() const
+  {
+    std::size_t result = 0;
+    for(auto& w : workers_)
+    {
+      result += w->num_stolen.load(std::memory_order_relaxed);
+    }
+
+    return result;
+  }
+
+  // runs f() on some worker
+  //
+  // as on a std::thread, an exception escaping f terminates the program
+  template<class F>
+  void execute(F&& f)
+  {
+    task* t = new task_of<std::decay_t<F>>{std::forward<F>(f)};
+
+    if(current_executor_ == this)
+    {
+      workers_[current_worker_]->tasks.push(t);
+    }
+    else
+    {
+      std::lock_guard lock{injected_mutex_};
+      injected_.push_back(t);
+    }
+
+    wake_one();
+  }
+
+  // runs handle(msg, response) on some worker, then complete(response) on the same worker
+  //
+  // if handle throws, complete receives a 500 (Internal Server Error) response instead
+  //
+  // complete runs on the worker, not on the thread that owns msg's connection, so it must hand
+  // the response back to that thread, e.g. by queueing it and writing to an eventfd the
+  // thread's event loop waits on, rather than touch the connection itself
+  template<class Message, class Handle, class Complete>
+  void submit(Message msg, Handle handle, Complete complete)
+  {
+    execute([msg = std::move(msg), handle = std::move(handle), complete = std::move(complete)]() mutable
+    {
+      full_response response;
+
+      try
+      {
+        handle(msg, response);
+      }
+      catch(...)
+      {
+        response.reset();
+        response.sl.version = http_version{1, 1};
+        response.sl.code.number = 500;
+        assign_string(response.sl.reason, "Internal Server Error");
+      }
+
+      complete(response);
+    });
+  }
+
+  private:
+    struct task
+    {
+      virtual ~task() = default;
+      virtual void run() = 0;
+    };
+
+    template<class F>
+    struct task_of : task
+    {
+      explicit task_of(F f)
+        : f{std::move(f)}
+      {}
+
+      void run() override
+      {
+        f();
+      }
+
+      F f;
+    };
+
+    struct worker
+    {
+      chase_lev_deque<task*> tasks;
+      std::thread thread;
+      std::atomic<std::size_t> num_stolen{0};
+    };
+
+    // the most tasks a worker moves from the shared queue onto its deque at once
+    static constexpr std::size_t max_batch = 64;
+
+    // returns a task from this worker's own deque, the shared queue, or another worker's deque
+    task* find_task(std::size_t self, std::minstd_rand& random)
+    {
+      if(std::optional<task*> t = workers_[self]->tasks.pop())
+      {
+        return *t;
+      }
+
+      if(task* t = take_injected(self))
+      {
+        return t;
+      }
+
+      // visit every other worker, starting from a random one so that thieves spread out
+      std::size_t n = workers_.size();
+      std::size_t first = random() % n;
+      for(std::size_t i = 0; i != n; ++i)
+      {
+        std::size_t victim = (first + i) % n;
+        if(victim == self) continue;
+
+        if(std::optional<task*> t = workers_[victim]->tasks.steal())
+        {
+          workers_[self]->num_stolen.fetch_add(1, std::memory_order_relaxed);
+          return *t;
+        }
+      }
+
+      return nullptr;
+    }
+
+    // returns the oldest task submitted from outside the pool, after moving up to max_batch of
+    // those behind it onto this worker's deque, where idle workers may steal them
+    task* take_injected(std::size_t self)
+    {
+      task* result = nullptr;
+      std::size_t n = 0;
+
+      {
+        std::lock_guard lock{injected_mutex_};
+        if(injected_.empty())
+        {
+          return nullptr;
+        }
+
+        result = injected_.front();
+        injected_.pop_front();
+
+        // pushed newest first, so that this worker pops them in the order they were submitted
+        n = std::min(injected_.size(), max_batch);
+        for(std::size_t i = n; i != 0; --i)
+        {
+          workers_[self]->tasks.push(injected_[i - 1]);
+        }
+        injected_.erase(injected_.begin(), injected_.begin() + n);
+      }
+
+      if(n != 0)
+      {
+        wake_one();
+      }
+
+      return result;
+    }
+
+    void work(std::size_t self)
+    {
+      current_executor_ = this;
+      current_worker_ = self;
+      std::minstd_rand random(self + 1);
+
+      for(;;)
+      {
+        // read before looking for work, so that any task submitted after the look changes it
+        std::uint64_t seen = version_.load();
+
+        if(task* t = find_task(self, random))
+        {
+          t->run();
+          delete t;
+          continue;
+        }
+
+        if(stopping_.load())
+        {
+          return;
+        }
+
+        std::unique_lock lock{sleep_mutex_};
+        sleepers_.fetch_add(1);
+        wake_.wait(lock, [&]{ return version_.load() != seen or stopping_.load(); });
+        sleepers_.fetch_sub(1);
+      }
+    }
+
+    void wake_one()
+    {
+      version_.fetch_add(1);
+
+      if(sleepers_.load() != 0)
+      {
+        std::lock_guard lock{sleep_mutex_};
+        wake_.notify_one();
+      }
+    }
+
+    void wake_all()
+    {
+      version_.fetch_add(1);
+
+      std::lock_guard lock{sleep_mutex_};
+      wake_.notify_all();
+    }
+
+    std::vector<std::unique_ptr<worker>> workers_;
+
+    // tasks submitted from outside the pool
+    std::mutex injected_mutex_;
+    std::deque<task*> injected_;
+
+    // idle workers sleep until a submission changes version_
+    std::mutex sleep_mutex_;
+    std::condition_variable wake_;
+    std::atomic<std::uint64_t> version_{0};
+    std::atomic<unsigned> sleepers_{0};
+    std::atomic<bool> stopping_{false};
+
+    static inline thread_local work_stealing_executor* current_executor_ = nullptr;
+    static inline thread_local std::size_t current_worker_ = 0;
+};
+
+
+} // end hattip
+
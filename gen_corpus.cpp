@@ -0,0 +1,316 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+#include "corpus.hpp"
+
+// generates a corpus of requests and responses for the benchmarks and test_parser
+//
+// usage: gen_corpus [--option=value ...] > corpus.txt
+//
+// sizes follow log-normal distributions given by their median, and counts follow Poisson
+// distributions given by their mean, which is roughly how real traffic is shaped:
+// most messages are small, but a few are very large
+struct options
+{
+  std::size_t count = 1000;
+  std::uint64_t seed = 1;
+
+  // the fraction of messages which are responses
+  double responses = 0.5;
+
+  // the relative weight of each request method
+  std::map<std::string, double> methods = {{"GET", 70}, {"POST", 20}, {"PUT", 4}, {"DELETE", 4}, {"HEAD", 2}};
+
+  // the relative weight of each response status code
+  std::map<std::string, double> statuses = {{"200", 80}, {"204", 3}, {"301", 3}, {"304", 8}, {"404", 5}, {"500", 1}};
+
+  double uri_length = 40;
+  double headers = 8;
+  double header_length = 24;
+
+  // the fraction of requests carrying a Cookie header, and its length
+  double cookies = 0.5;
+  double cookie_length = 200;
+
+  double body_length = 512;
+
+  // the fraction of Entity-Bodies sent with the chunked Transfer-Encoding rather than Content-Length
+  double chunked = 0.2;
+  double chunk_length = 256;
+
+  // the spread of every log-normal distribution
+  double sigma = 1.0;
+};
+
+
+const char* usage = R"(usage: gen_corpus [--option=value ...] > corpus.txt
+
+  --count=N             number of messages (1000)
+  --seed=N              random seed (1)
+  --responses=F         fraction of messages which are responses (0.5)
+  --methods=M:W,...     weight of each request method (GET:70,POST:20,PUT:4,DELETE:4,HEAD:2)
+  --statuses=S:W,...    weight of each response status (200:80,204:3,301:3,304:8,404:5,500:1)
+  --uri-length=N        median Request-URI length (40)
+  --headers=N           mean number of headers (8)
+  --header-length=N     median header value length (24)
+  --cookies=F           fraction of requests with a Cookie (0.5)
+  --cookie-length=N     median Cookie length (200)
+  --body-length=N       median Entity-Body length (512)
+  --chunked=F           fraction of Entity-Bodies which are chunked (0.2)
+  --chunk-length=N      median chunk length (256)
+  --sigma=F             spread of the log-normal size distributions (1.0)
+)";
+
+
+std::map<std::string, double> parse_weights(const std::string& list)
+{
+  std::map<std::string, double> result;
+
+  std::size_t begin = 0;
+  while(begin < list.size())
+  {
+    std::size_t end = list.find(',', begin);
+    if(end == std::string::npos) end = list.size();
+
+    std::string item = list.substr(begin, end - begin);
+    std::size_t colon = item.find(':');
+    if(colon == std::string::npos)
+    {
+      throw std::runtime_error{"Expected NAME:WEIGHT in \"" + item + "\""};
+    }
+
+    double weight = std::stod(item.substr(colon + 1));
+    if(not (weight >= 0))
+    {
+      throw std::runtime_error{"Expected a non-negative WEIGHT in \"" + item + "\""};
+    }
+
+    result[item.substr(0, colon)] = weight;
+    begin = end + 1;
+  }
+
+  // std::discrete_distribution requires a positive total weight
+  if(std::none_of(result.begin(), result.end(), [](const auto& item){ return item.second > 0; }))
+  {
+    throw std::runtime_error{"Expected a positive WEIGHT in \"" + list + "\""};
+  }
+
+  return result;
+}
+
+
+options parse_options(int argc, char** argv)
+{
+  options result;
+
+  for(int i = 1; i != argc; ++i)
+  {
+    std::string arg = argv[i];
+    std::size_t equals = arg.find('=');
+    std::string name = arg.substr(0, equals);
+    std::string value = equals == std::string::npos ? "" : arg.substr(equals + 1);
+
+    if(name == "--count")              result.count = std::stoull(value);
+    else if(name == "--seed")          result.seed = std::stoull(value);
+    else if(name == "--responses")     result.responses = std::stod(value);
+    else if(name == "--methods")       result.methods = parse_weights(value);
+    else if(name == "--statuses")      result.statuses = parse_weights(value);
+    else if(name == "--uri-length")    result.uri_length = std::stod(value);
+    else if(name == "--headers")       result.headers = std::stod(value);
+    else if(name == "--header-length") result.header_length = std::stod(value);
+    else if(name == "--cookies")       result.cookies = std::stod(value);
+    else if(name == "--cookie-length") result.cookie_length = std::stod(value);
+    else if(name == "--body-length")   result.body_length = std::stod(value);
+    else if(name == "--chunked")       result.chunked = std::stod(value);
+    else if(name == "--chunk-length")  result.chunk_length = std::stod(value);
+    else if(name == "--sigma")         result.sigma = std::stod(value);
+    else
+    {
+      std::cerr << usage;
+      std::exit(name == "--help" ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+  }
+
+  return result;
+}
+
+
+struct generator
+{
+  options opts;
+  std::mt19937_64 rng;
+
+  bool coin(double probability)
+  {
+    return std::bernoulli_distribution{probability}(rng);
+  }
+
+  std::size_t size(double median)
+  {
+    if(median <= 0) return 0;
+    return static_cast<std::size_t>(std::lognormal_distribution<double>{std::log(median), opts.sigma}(rng));
+  }
+
+  std::size_t count(double mean)
+  {
+    if(mean <= 0) return 0;
+    return std::poisson_distribution<std::size_t>{mean}(rng);
+  }
+
+  const std::string& pick(const std::map<std::string, double>& weights)
+  {
+    std::vector<double> w;
+    for(const auto& [name, weight] : weights) w.push_back(weight);
+
+    auto i = weights.begin();
+    std::advance(i, std::discrete_distribution<std::size_t>{w.begin(), w.end()}(rng));
+    return i->first;
+  }
+
+  std::string text(std::size_t n, std::string_view alphabet)
+  {
+    std::uniform_int_distribution<std::size_t> index{0, alphabet.size() - 1};
+
+    std::string result(n, ' ');
+    for(char& c : result)
+    {
+      c = alphabet[index(rng)];
+    }
+
+    return result;
+  }
+
+  std::string uri()
+  {
+    std::string result = "/" + text(size(opts.uri_length), "abcdefghijklmnopqrstuvwxyz0123456789/-_.");
+
+    if(coin(0.3))
+    {
+      result += "?" + text(size(opts.uri_length / 2), "abcdefghijklmnopqrstuvwxyz0123456789=&%");
+    }
+
+    return result;
+  }
+
+  std::string header_value(double median)
+  {
+    return text(size(median), "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789 -_./;=,");
+  }
+
+  std::string headers(bool is_request)
+  {
+    static const char* request_names[] = {"User-Agent", "Accept", "Accept-Encoding", "Accept-Language", "Referer", "Cache-Control", "X-Request-Id", "Origin"};
+    static const char* response_names[] = {"Server", "Date", "Content-Type", "Cache-Control", "ETag", "Last-Modified", "Vary", "X-Request-Id"};
+
+    std::string result;
+
+    if(is_request)
+    {
+      result += "Host: example.com\r\n";
+    }
+
+    for(std::size_t i = 0, n = count(opts.headers); i != n; ++i)
+    {
+      const char* name = is_request ? request_names[rng() % std::size(request_names)] : response_names[rng() % std::size(response_names)];
+      result += std::string{name} + ": " + header_value(opts.header_length) + "\r\n";
+    }
+
+    if(is_request and coin(opts.cookies))
+    {
+      result += "Cookie: " + header_value(opts.cookie_length) + "\r\n";
+    }
+
+    return result;
+  }
+
+  // appends the framing headers, the blank line, and an Entity-Body
+  std::string body()
+  {
+    std::string data = text(size(opts.body_length), "abcdefghijklmnopqrstuvwxyz0123456789\r\n{}\":,");
+
+    if(not coin(opts.chunked))
+    {
+      return "Content-Length: " + std::to_string(data.size()) + "\r\n\r\n" + data;
+    }
+
+    std::string result = "Transfer-Encoding: chunked\r\n\r\n";
+
+    std::size_t offset = 0;
+    while(offset != data.size())
+    {
+      std::size_t n = std::min(std::max<std::size_t>(size(opts.chunk_length), 1), data.size() - offset);
+
+      char hex[32];
+      std::snprintf(hex, sizeof(hex), "%zx", n);
+
+      result += std::string{hex} + "\r\n" + data.substr(offset, n) + "\r\n";
+      offset += n;
+    }
+
+    return result + "0\r\n\r\n";
+  }
+
+  std::string request()
+  {
+    const std::string& method = pick(opts.methods);
+    std::string result = method + " " + uri() + " HTTP/1.1\r\n" + headers(true);
+
+    if(method == "POST" or method == "PUT" or method == "PATCH")
+    {
+      return result + body();
+    }
+
+    return result + "\r\n";
+  }
+
+  std::string response()
+  {
+    static const std::map<std::string, std::string> reasons = {
+      {"200", "OK"}, {"201", "Created"}, {"204", "No Content"}, {"301", "Moved Permanently"}, {"302", "Moved Temporarily"},
+      {"304", "Not Modified"}, {"400", "Bad Request"}, {"401", "Unauthorized"}, {"403", "Forbidden"}, {"404", "Not Found"},
+      {"500", "Internal Server Error"}, {"501", "Not Implemented"}, {"502", "Bad Gateway"}, {"503", "Service Unavailable"}
+    };
+
+    const std::string& status = pick(opts.statuses);
+    auto reason = reasons.find(status);
+    std::string result = "HTTP/1.1 " + status + " " + (reason == reasons.end() ? "Unknown" : reason->second) + "\r\n" + headers(false);
+
+    // 1xx, 204 and 304 responses never have an Entity-Body
+    if(status[0] == '1' or status == "204" or status == "304")
+    {
+      return result + "\r\n";
+    }
+
+    return result + body();
+  }
+
+  std::string message()
+  {
+    return coin(opts.responses) ? response() : request();
+  }
+};
+
+
+int main(int argc, char** argv)
+{
+  options opts = parse_options(argc, argv);
+  generator gen{opts, std::mt19937_64{opts.seed}};
+
+  std::ios::sync_with_stdio(false);
+
+  hattip::corpus::write_header(std::cout);
+  for(std::size_t i = 0; i != opts.count; ++i)
+  {
+    hattip::corpus::write_entry(std::cout, gen.message());
+  }
+
+  return 0;
+}
+
@@ -1,36 +1,252 @@
 #pragma once
 
 #include <algorithm>
+#include <array>
+#include <bit>
 #include <cassert>
-#include <cctype>
+#include <charconv>
+#include <cstdint>
 #include <cstring>
+#include <functional>
 #include <iostream>
+#include <limits>
+#include <memory>
+#include <memory_resource>
+#include <deque>
 #include <optional>
-#include <set>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
 #include <variant>
 #include <vector>
 
+#if defined(__SSE2__) or defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#if __has_include(<sys/uio.h>)
+#include <sys/uio.h>
+#endif
+
 
 namespace hattip
 {
 
 
-inline bool is_number(const std::string& s)
+// the classes of characters the lexer and grammar distinguish, as bits of char_class_table
+enum char_class : std::uint8_t
+{
+  ctl_char      = 1 << 0,
+  tspecial_char = 1 << 1,
+  digit_char    = 1 << 2,
+  alpha_char    = 1 << 3,
+  lws_char      = 1 << 4,
+  token_char    = 1 << 5
+};
+
+
+constexpr std::string_view tspecials = "()<>@,;:\\\"/[]?={} \t";
+
+
+constexpr std::array<std::uint8_t, 256> make_char_class_table()
+{
+  std::array<std::uint8_t, 256> result{};
+
+  for(int ch = 0; ch != 256; ++ch)
+  {
+    // CTL := <any US-ASCII control character (octets 0 - 31) and DEL (127)>
+    if(ch <= 31 or ch == 127) result[ch] |= ctl_char;
+
+    if(tspecials.find(static_cast<char>(ch)) != std::string_view::npos) result[ch] |= tspecial_char;
+
+    if('0' <= ch and ch <= '9') result[ch] |= digit_char;
+
+    if(('a' <= ch and ch <= 'z') or ('A' <= ch and ch <= 'Z')) result[ch] |= alpha_char;
+
+    // SP and HT, which may follow an optional CRLF in LWS
+    if(ch == ' ' or ch == '\t') result[ch] |= lws_char;
+
+    // token := 1*<any CHAR except CTLs or tspecials>
+    if(not (result[ch] & (ctl_char | tspecial_char))) result[ch] |= token_char;
+  }
+
+  return result;
+}
+
+
+constexpr std::array<std::uint8_t, 256> char_class_table = make_char_class_table();
+
+
+constexpr bool has_char_class(char ch, std::uint8_t classes)
+{
+  return char_class_table[static_cast<unsigned char>(ch)] & classes;
+}
+
+
+inline bool is_number(std::string_view s)
 {
-  return !s.empty() and std::all_of(s.begin(), s.end(), [](char c){ return std::isdigit(c); });
+  return !s.empty() and std::all_of(s.begin(), s.end(), [](char c){ return has_char_class(c, digit_char); });
 }
 
 
-template<class T>
-inline bool contains(const std::set<T>& s, const T& x)
+constexpr char to_lower(char ch)
+{
+  return has_char_class(ch, alpha_char) ? (ch | 0x20) : ch;
+}
+
+
+// compares two field names, ignoring case
+constexpr bool iequals(std::string_view a, std::string_view b)
+{
+  return a.size() == b.size() and std::equal(a.begin(), a.end(), b.begin(), [](char x, char y)
+  {
+    return to_lower(x) == to_lower(y);
+  });
+}
+
+
+// the allocator String allocates its characters with, or std::allocator<char> for strings
+// which don't allocate, like std::string_view
+template<class String>
+struct allocator_of
+{
+  using type = std::allocator<char>;
+};
+
+template<class String>
+  requires requires { typename String::allocator_type; }
+struct allocator_of<String>
+{
+  using type = typename String::allocator_type;
+};
+
+template<class String>
+using allocator_of_t = typename allocator_of<String>::type;
+
+
+// String's allocator, rebound to allocate T
+template<class String, class T>
+using rebind_allocator_t = typename std::allocator_traits<allocator_of_t<String>>::template rebind_alloc<T>;
+
+
+// constructs a String from args, using alloc if String allocates
+template<class String, class... Args>
+inline String make_string(const allocator_of_t<String>& alloc, Args&&... args)
+{
+  if constexpr(std::is_constructible_v<String, Args..., const allocator_of_t<String>&>)
+  {
+    return String(std::forward<Args>(args)..., alloc);
+  }
+  else
+  {
+    return String(std::forward<Args>(args)...);
+  }
+}
+
+
+// holds the allocator of an object which, like a std::pmr container, keeps its allocator when assigned to
+template<class Allocator>
+struct allocator_holder
+{
+  Allocator allocator;
+
+  allocator_holder() = default;
+
+  allocator_holder(const Allocator& alloc)
+    : allocator(alloc)
+  {}
+
+  allocator_holder(const allocator_holder&) = default;
+
+  allocator_holder& operator=(const allocator_holder&)
+  {
+    return *this;
+  }
+};
+
+
+// returns the allocator of s, or a default allocator if s doesn't allocate
+template<class String>
+inline allocator_of_t<String> get_allocator(const String& s)
+{
+  if constexpr(requires { s.get_allocator(); })
+  {
+    return s.get_allocator();
+  }
+  else
+  {
+    return {};
+  }
+}
+
+
+// assigns the characters of value to s, which may itself be a view
+template<class String>
+inline void assign_string(String& s, std::string_view value)
+{
+  if constexpr(std::is_base_of_v<std::string_view, String>)
+  {
+    static_cast<std::string_view&>(s) = value;
+  }
+  else
+  {
+    s.assign(value.data(), value.size());
+  }
+}
+
+
+// empties s, keeping its capacity
+template<class String>
+inline void clear_string(String& s)
+{
+  if constexpr(std::is_base_of_v<std::string_view, String>)
+  {
+    static_cast<std::string_view&>(s) = std::string_view{};
+  }
+  else
+  {
+    s.clear();
+  }
+}
+
+
+// returns the alternative T of v emptied with reset(), or else emplaces a new T constructed with alloc
+//
+// reusing the alternative a variant already holds keeps the capacity of its strings and vectors,
+// so parsing into it again needn't allocate
+template<class T, class Variant, class Allocator>
+inline T& reset_or_emplace(Variant& v, const Allocator& alloc)
+{
+  if(T* existing = std::get_if<T>(&v))
+  {
+    existing->reset();
+    return *existing;
+  }
+
+  return v.template emplace<T>(alloc);
+}
+
+
+// FNV-1a hash of a field name, ignoring case
+constexpr std::uint32_t ihash(std::string_view s)
 {
-  return s.find(x) != s.end();
+  std::uint32_t result = 2166136261u;
+
+  for(char ch : s)
+  {
+    result ^= static_cast<unsigned char>(to_lower(ch));
+    result *= 16777619u;
+  }
+
+  return result;
 }
 
 
-std::string show_specials(const std::string& s)
+std::string show_specials(std::string_view s)
 {
-  std::string result = s;
+  std::string result{s};
 
   if(result == " ")
   {
@@ -49,7 +265,7 @@ std::string show_specials(const std::string& s)
 }
 
 
-const std::set<int> known_status_codes = {
+constexpr int known_status_codes[] = {
   100,
   101,
   200,
@@ -85,713 +301,3404 @@ const std::set<int> known_status_codes = {
 };
 
 
-inline bool is_known_status_code(int c)
+// bit c of known_status_code_bits is set when c is a known status code
+constexpr std::array<std::uint64_t, 10> make_known_status_code_bits()
 {
-  return contains(known_status_codes, c);
+  std::array<std::uint64_t, 10> result{};
+
+  for(int c : known_status_codes)
+  {
+    result[c / 64] |= std::uint64_t{1} << (c % 64);
+  }
+
+  return result;
 }
 
 
-const std::set<char> tspecials = {
-  '(',
-  ')',
-  '<',
-  '>',
-  '@',
-  ',',
-  ';',
-  ':',
-  '\\',
-  '\"',
-  '/',
-  '[',
-  ']',
-  '?',
-  '=',
-  '{',
-  '}',
-  ' ',
-  9    // horizontal-tab
-};
+constexpr std::array<std::uint64_t, 10> known_status_code_bits = make_known_status_code_bits();
+
+
+constexpr bool is_known_status_code(int c)
+{
+  return 0 <= c and c < 640 and (known_status_code_bits[c / 64] & (std::uint64_t{1} << (c % 64)));
+}
 
 
-inline bool is_tspecial(char ch)
+constexpr bool is_tspecial(char ch)
 {
-  return contains(tspecials, ch);
+  return has_char_class(ch, tspecial_char);
 }
 
-inline bool is_tspecial(const std::string& s)
+constexpr bool is_tspecial(std::string_view s)
 {
   return s.size() == 1 and is_tspecial(s.front());
 }
 
 
-inline bool is_ctl(char ch)
+constexpr bool is_ctl(char ch)
 {
-  return (0 <= ch and ch <= 31) or (ch == 127);
+  return has_char_class(ch, ctl_char);
 }
 
 
-inline bool is_ctl(const std::string& s)
+constexpr bool is_ctl(std::string_view s)
 {
   return s.size() == 1 and is_ctl(s.front());
 }
 
 
-const std::set<const char*> known_methods = {
-  "\"OPTIONS\"",
-  "\"GET\"",
-  "\"HEAD\"",
-  "\"POST\"",
-  "\"PUT\"",
-  "\"PATCH\"",
-  "\"COPY\"",
-  "\"MOVE\"",
-  "\"DELETE\"",
-  "\"LINK\"",
-  "\"UNLINK\"",
-  "\"TRACE\"",
-  "\"WRAPPED\"",
+enum class method_id : std::uint8_t
+{
+  options,
+  get,
+  head,
+  post,
+  put,
+  patch,
+  copy,
+  move,
+  delete_,
+  link,
+  unlink,
+  trace,
+  wrapped,
+  extension
 };
 
 
-inline bool is_known_method(const char* s)
-{
-  return contains(known_methods, s);
-}
+// the names of the known methods, indexed by method_id
+constexpr std::string_view known_methods[] = {
+  "OPTIONS",
+  "GET",
+  "HEAD",
+  "POST",
+  "PUT",
+  "PATCH",
+  "COPY",
+  "MOVE",
+  "DELETE",
+  "LINK",
+  "UNLINK",
+  "TRACE",
+  "WRAPPED",
+};
 
 
-struct lexer
+// packs a string of at most eight characters into an integer,
+// so that short strings can be compared in a single instruction
+constexpr std::uint64_t pack(std::string_view s)
 {
-  inline lexer(std::istream& input)
-    : current_token_{}, input_{input}
-  {
-    next();
-  }
+  std::uint64_t result = 0;
 
-  inline lexer& operator>>(std::string& s)
+  for(std::size_t i = 0; i != s.size(); ++i)
   {
-    s = current_token_;
-    next();
-    return *this;
+    result |= std::uint64_t{static_cast<unsigned char>(s[i])} << (8 * i);
   }
 
-  inline lexer& operator>>(int& number)
-  {
-    std::string tmp;
-    *this >> tmp;
-    number = std::stoi(tmp);
+  return result;
+}
 
-    return *this;
-  }
 
-  inline lexer& operator>>(const char* literal)
+constexpr method_id to_method_id(std::string_view s)
+{
+  // every known method name fits in eight characters
+  if(s.empty() or s.size() > 8)
   {
-    if(literal == current_token_)
-    {
-      next();
-    }
-    else
-    {
-      auto what = std::string{"Expected \""};
+    return method_id::extension;
+  }
 
-      if(std::strcmp(literal, "\r") == 0)
-      {
-        what += "<CR>";
-      }
-      else if(std::strcmp(literal, "\n") == 0)
-      {
-        what += "<LF>";
-      }
-      else
-      {
-        what += literal;
-      }
-      
-      what += "\"";
+  switch(pack(s))
+  {
+    case pack("OPTIONS"): return method_id::options;
+    case pack("GET"):     return method_id::get;
+    case pack("HEAD"):    return method_id::head;
+    case pack("POST"):    return method_id::post;
+    case pack("PUT"):     return method_id::put;
+    case pack("PATCH"):   return method_id::patch;
+    case pack("COPY"):    return method_id::copy;
+    case pack("MOVE"):    return method_id::move;
+    case pack("DELETE"):  return method_id::delete_;
+    case pack("LINK"):    return method_id::link;
+    case pack("UNLINK"):  return method_id::unlink;
+    case pack("TRACE"):   return method_id::trace;
+    case pack("WRAPPED"): return method_id::wrapped;
+    default:              return method_id::extension;
+  }
+}
 
-      throw std::runtime_error{what};
-    }
 
-    return *this;
-  }
+constexpr bool is_known_method(std::string_view s)
+{
+  return to_method_id(s) != method_id::extension;
+}
 
-  inline std::string next()
-  {
-    std::string result = current_token_;
 
-    char ch = input_.peek();
-    if(ch == std::istream::traits_type::eof())
-    {
-      // first look for EOF
+// the scanning kernels below find the first character of a string matching some character class,
+// examining 32 (AVX2) or 16 (SSE2) characters at a time before falling back to a scalar loop
+// for the remainder
+//
+// each character class is a type with two matching functions:
+//
+// * scalar(ch) returns whether a single character is a member
+// * vector<isa>(v) returns a mask of the lanes of the vector v which are members
 
-      current_token_.clear();
-    }
-    else if(ch == ' ' or ch == '\r' or ch == '\n')
-    {
-      // look for a space, CR, or LF
 
-      current_token_ = input_.get();
-    }
-    else if(is_tspecial(ch))
-    {
-      // look for a tspecial
+#if defined(__SSE2__)
+struct sse2
+{
+  using vector = __m128i;
 
-      current_token_ = input_.get();
-    }
-    else if(std::isdigit(ch))
-    {
-      // look for a number
+  static vector load(const char* ptr) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(ptr)); }
+  static vector zero() { return _mm_setzero_si128(); }
+  static vector splat(char ch) { return _mm_set1_epi8(ch); }
+  static vector equal(vector a, vector b) { return _mm_cmpeq_epi8(a, b); }
+  static vector either(vector a, vector b) { return _mm_or_si128(a, b); }
 
-      current_token_.clear();
+  // the lanes whose unsigned value is no greater than ch
+  static vector at_most(vector a, char ch) { return _mm_cmpeq_epi8(_mm_min_epu8(a, splat(ch)), a); }
 
-      while(std::isdigit(ch))
-      {
-        current_token_.push_back(ch);
-        input_.get();
-        ch = input_.peek();
-      }
-    }
-    else if(std::isalpha(ch))
-    {
-      // look for a word
-      
-      current_token_.clear();
+  static unsigned int bits(vector a) { return static_cast<unsigned int>(_mm_movemask_epi8(a)); }
+};
+#endif
 
-      while(std::isalpha(ch))
-      {
-        current_token_.push_back(ch);
-        input_.get();
-        ch = input_.peek();
-      }
-    }
-    else
-    {
-      // by default, just return the single character
 
-      current_token_ = ch;
-      input_.get();
-    }
+#if defined(__AVX2__)
+struct avx2
+{
+  using vector = __m256i;
 
-    return result;
-  }
+  static vector load(const char* ptr) { return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(ptr)); }
+  static vector zero() { return _mm256_setzero_si256(); }
+  static vector splat(char ch) { return _mm256_set1_epi8(ch); }
+  static vector equal(vector a, vector b) { return _mm256_cmpeq_epi8(a, b); }
+  static vector either(vector a, vector b) { return _mm256_or_si256(a, b); }
 
-  const std::string& peek() const
-  {
-    return current_token_;
-  }
+  // the lanes whose unsigned value is no greater than ch
+  static vector at_most(vector a, char ch) { return _mm256_cmpeq_epi8(_mm256_min_epu8(a, splat(ch)), a); }
 
-  std::string current_token_;
-  std::istream &input_;
+  static unsigned int bits(vector a) { return static_cast<unsigned int>(_mm256_movemask_epi8(a)); }
 };
+#endif
 
 
-struct request_uri : public std::string
+// returns the index of the first character of s which is a member of CharClass, or s.size()
+template<class CharClass>
+inline std::size_t find_first(std::string_view s)
 {
-  using std::string::string;
+  std::size_t i = 0;
 
-  // Request-URI := "*" | absoluteURI | abs_path
-  // XXX for now, just accept any string not containing whitespace
-  friend lexer& operator>>(lexer& lex, request_uri& self)
+#if defined(__AVX2__)
+  for(; i + 32 <= s.size(); i += 32)
+  {
+    unsigned int found = avx2::bits(CharClass::template vector<avx2>(avx2::load(s.data() + i)));
+    if(found)
+    {
+      return i + std::countr_zero(found);
+    }
+  }
+#endif
+
+#if defined(__SSE2__)
+  for(; i + 16 <= s.size(); i += 16)
   {
-    return lex >> static_cast<std::string&>(self);
+    unsigned int found = sse2::bits(CharClass::template vector<sse2>(sse2::load(s.data() + i)));
+    if(found)
+    {
+      return i + std::countr_zero(found);
+    }
   }
+#endif
 
-  friend std::ostream& operator<<(std::ostream& os, const request_uri& self)
+  for(; i != s.size(); ++i)
   {
-    return os << static_cast<const std::string&>(self);
+    if(CharClass::scalar(s[i]))
+    {
+      return i;
+    }
   }
-};
 
+  return s.size();
+}
 
-struct simple_request
-{
-  request_uri uri;
 
-  // Simple-Request := "GET" SP Request-URI CRLF
-  friend lexer& operator>>(lexer& lex, simple_request& self)
+// the character class of the characters Chars...
+template<char... Chars>
+struct one_of
+{
+  static bool scalar(char ch)
   {
-    return lex >> "GET" >> " " >> self.uri >> "\r" >> "\n";
+    return ((ch == Chars) or ...);
   }
 
-  friend std::ostream& operator<<(std::ostream& os, const simple_request& self)
+  template<class ISA>
+  static typename ISA::vector vector(typename ISA::vector v)
   {
-    return os << "GET" << " " << self.uri << "\r" << "\n";
+    typename ISA::vector result = ISA::zero();
+    ((result = ISA::either(result, ISA::equal(v, ISA::splat(Chars)))), ...);
+    return result;
   }
 };
 
 
-// LWS := [CRLF] 1*( SP | HT )
-inline bool is_lws(const std::string& s)
+// the character class of CTLs and tspecials, i.e. the characters which end a token
+struct tspecial_or_ctl
 {
-  int i = 0;
+  using tspecial = one_of<'(', ')', '<', '>', '@', ',', ';', ':', '\\', '\"', '/', '[', ']', '?', '=', '{', '}', ' ', 9>;
 
-  // skip past optional CRLF
-  if(s.size() >= 2)
+  static bool scalar(char ch)
   {
-    if(s[i] == '\r' and s[i] == '\n')
-    {
-      i += 2;
-    }
+    return has_char_class(ch, ctl_char | tspecial_char);
   }
 
-  // neither an empty string nor CRLF alone is lws
-  // there needs to be at least one character of white space
-  if(i == s.size())
+  template<class ISA>
+  static typename ISA::vector vector(typename ISA::vector v)
   {
-    return false;
+    // CTL := <any US-ASCII control character (octets 0 - 31) and DEL (127)>
+    typename ISA::vector ctl = ISA::either(ISA::at_most(v, 31), ISA::equal(v, ISA::splat(127)));
+    return ISA::either(ctl, tspecial::template vector<ISA>(v));
   }
+};
 
-  for(; i != s.size(); ++i)
-  {
-    // any character besides SP or HT is not LWS
-    // horizontal tab is ASCII 9
-    if(s[i] != ' ' or s[i] != 9)
-    {
-      return false;
-    }
-  }
 
-  return true;
+inline std::size_t find_cr(std::string_view s)
+{
+  return find_first<one_of<'\r'>>(s);
 }
 
 
-// qdtext := <any CHAR except <"> and CTLs, but including LWS>
-inline bool is_qdtext(const std::string& s)
+inline std::size_t find_cr_or_lf(std::string_view s)
 {
-  if(is_lws(s)) return true;
+  return find_first<one_of<'\r', '\n'>>(s);
+}
 
-  if(s == "\"") return false;
 
-  if(is_ctl(s)) return false;
+// whitespace := SP | HT | CR | LF
+inline std::size_t find_whitespace(std::string_view s)
+{
+  return find_first<one_of<' ', '\t', '\r', '\n'>>(s);
+}
 
-  return true;
+
+inline std::size_t find_tspecial_or_ctl(std::string_view s)
+{
+  return find_first<tspecial_or_ctl>(s);
 }
 
 
-struct quoted_string : std::string
+// finds nothing, so that scanning continues until the end of input
+inline std::size_t find_end(std::string_view s)
 {
-  // Quoted-String := <"> *(qdtext) <">
-  // qdtext := <any CHAR except <"> and CTLs, but including LWS>
-  friend lexer& operator>>(lexer& lex, quoted_string& self)
-  {
-    // open quote
-    lex >> "\"";
-    self += "\"";
+  return s.size();
+}
 
-    // consume text until we encounter another "
-    std::string tmp;
-    while(lex.peek() != "\"")
-    {
-      if(!is_qdtext(lex.peek()))
-      {
-        throw std::runtime_error{"Expected qdtext"};
-      }
 
-      lex >> tmp;
-      self += tmp;
-    }
+enum class parse_status
+{
+  need_more,
+  done,
+  error
+};
 
-    // close quote
-    lex >> "\"";
-    self += "\"";
 
-    return lex;
-  }
+enum class parse_errc
+{
+  none,
+  unexpected_end_of_input,
+  expected_literal,
+  expected_qdtext,
+  expected_token,
+  expected_number,
+  invalid_status_code,
+  invalid_content_length,
+  invalid_transfer_encoding,
+  invalid_chunked_body
 };
 
 
-struct token : std::string
+inline const char* describe(parse_errc error)
 {
+  switch(error)
+  {
+    case parse_errc::none:                      return "No error";
+    case parse_errc::unexpected_end_of_input:   return "Unexpected end of input";
+    case parse_errc::expected_literal:          return "Expected literal";
+    case parse_errc::expected_qdtext:           return "Expected qdtext";
+    case parse_errc::expected_token:            return "token: Expected at least one CHAR";
+    case parse_errc::expected_number:           return "Expected a number";
+    case parse_errc::invalid_status_code:       return "Unexpected status code number";
+    case parse_errc::invalid_content_length:    return "Invalid Content-Length";
+    case parse_errc::invalid_transfer_encoding: return "Invalid Transfer-Encoding";
+    case parse_errc::invalid_chunked_body:      return "Invalid Chunked-Body";
+  }
+
+  return "Unknown error";
+}
+
+
+// the outcome of parsing without exceptions
+//
+// on success, error is parse_errc::none and offset is the number of characters consumed;
+// on failure, offset is the position of the token at which the error was detected
+struct parse_result
+{
+  parse_errc error = parse_errc::none;
+  std::size_t offset = 0;
+
+  explicit operator bool() const
+  {
+    return error == parse_errc::none;
+  }
+};
+
+
+// the lexer has two modes:
+//
+// 1. reading from a std::istream, each token is copied into current_token_
+// 2. reading from a caller-owned contiguous buffer, each token is a view into the buffer
+//
+// in the second mode, tokens (and anything parsed into std::string_view) point into the
+// buffer, so the buffer must outlive them
+//
+// by default, malformed input throws std::runtime_error. with exceptions(false), the lexer
+// instead records the first error, like a std::istream's failbit, and then behaves as though
+// the input had ended, so that the parse unwinds through ordinary returns
+struct lexer
+{
+  inline lexer(std::istream& input)
+    : current_token_{}, input_{&input}, buffer_{}, position_{0}, token_begin_{0}
+  {
+    next();
+  }
+
+  inline lexer(std::span<const char> input)
+    : current_token_{}, input_{nullptr}, buffer_{input}, position_{0}, token_begin_{0}
+  {
+    next();
+  }
+
+  inline lexer& operator>>(std::string& s)
+  {
+    s = peek();
+    next();
+    return *this;
+  }
+
+  inline lexer& operator>>(std::string_view& s)
+  {
+    s = peek_view();
+    next();
+    return *this;
+  }
+
+  inline lexer& operator>>(int& number)
+  {
+    std::string_view digits = peek();
+    auto [end, error] = std::from_chars(digits.data(), digits.data() + digits.size(), number);
+
+    if(digits.empty() or error != std::errc{} or end != digits.data() + digits.size())
+    {
+      return fail(parse_errc::expected_number);
+    }
+
+    next();
+    return *this;
+  }
+
+  inline lexer& operator>>(const char* literal)
+  {
+    if(literal == peek())
+    {
+      next();
+    }
+    else
+    {
+      return fail(parse_errc::expected_literal, literal);
+    }
+
+    return *this;
+  }
+
+  // reports malformed input, which throws std::runtime_error when exceptions are enabled
+  //
+  // otherwise, the first error is recorded and the lexer behaves as though the input had ended
+  inline lexer& fail(parse_errc error, std::string_view detail = {})
+  {
+    if(throws_)
+    {
+      throw std::runtime_error{describe(error, detail)};
+    }
+
+    if(not failed())
+    {
+      error_ = parse_result{error, token_begin_};
+
+      if(input_)
+      {
+        current_token_.clear();
+      }
+      else
+      {
+        buffer_ = buffer_.first(token_begin_);
+        position_ = token_begin_;
+      }
+    }
+
+    return *this;
+  }
+
+  // enables or disables throwing on malformed input
+  void exceptions(bool enabled)
+  {
+    throws_ = enabled;
+  }
+
+  bool exceptions() const
+  {
+    return throws_;
+  }
+
+  bool failed() const
+  {
+    return error_.error != parse_errc::none;
+  }
+
+  // returns the first error, or else the number of characters consumed so far
+  parse_result result() const
+  {
+    return failed() ? error_ : parse_result{parse_errc::none, token_begin_};
+  }
+
+  // appends the current token to s and advances to the next token
+  // when s is a view, it must end where the current token begins
+  template<class String>
+  inline lexer& append_to(String& s)
+  {
+    append(s, peek());
+    next();
+    return *this;
+  }
+
+  // appends the input to s up to, but not including, the first character found by find,
+  // then advances to the token beginning with that character
+  //
+  // find(s) returns the index of the first character of s to stop at, or s.size()
+  //
+  // with a buffer input, the input is scanned in bulk; with a stream input, tokens are
+  // appended one at a time until one begins with a character to stop at
+  template<class String, class Finder>
+  inline lexer& append_until(String& s, Finder find)
+  {
+    if(input_)
+    {
+      while(not peek().empty() and find(peek().substr(0,1)) != 0)
+      {
+        append_to(s);
+      }
+    }
+    else
+    {
+      std::string_view rest{buffer_.data() + token_begin_, buffer_.size() - token_begin_};
+      std::size_t n = find(rest);
+
+      append(s, rest.substr(0, n));
+      position_ = token_begin_ + n;
+      next();
+    }
+
+    return *this;
+  }
+
+  // appends the next n characters of input to s in bulk, regardless of how they would be tokenized,
+  // then advances to the token following them
+  template<class String>
+  inline lexer& read(String& s, std::size_t n)
+  {
+    if(input_)
+    {
+      // the current token has already been extracted from the stream
+      std::size_t from_token = std::min(n, current_token_.size());
+      append(s, std::string_view{current_token_}.substr(0, from_token));
+
+      if(from_token < current_token_.size())
+      {
+        // the rest of a word or number is itself a word or number
+        current_token_.erase(0, from_token);
+        token_begin_ += from_token;
+        return *this;
+      }
+
+      read_from_stream(s, n - from_token);
+    }
+    else
+    {
+      if(n > buffer_.size() - token_begin_)
+      {
+        return fail(parse_errc::unexpected_end_of_input);
+      }
+
+      append(s, std::string_view{buffer_.data() + token_begin_, n});
+      position_ = token_begin_ + n;
+    }
+
+    next();
+    return *this;
+  }
+
+  // appends input to s in bulk for as long as framing consumes it, then advances to the token
+  // following it
+  //
+  // framing is an incremental parser like chunked_decoder with these members:
+  //
+  // * feed(chars, sink) consumes a prefix of chars, returning its size
+  // * status() returns parse_status::done when framing has consumed all it wants
+  // * wanted() returns how many more characters framing can consume without overshooting
+  template<class String, class Framing>
+  inline lexer& read_framed(String& s, Framing& framing)
+  {
+    auto ignore = [](std::string_view){};
+
+    if(input_)
+    {
+      // the current token has already been extracted from the stream
+      std::size_t from_token = framing.feed(current_token_, ignore);
+      append(s, std::string_view{current_token_}.substr(0, from_token));
+
+      if(from_token < current_token_.size())
+      {
+        current_token_.erase(0, from_token);
+        token_begin_ += from_token;
+      }
+      else
+      {
+        // read exactly what framing wants, so that we never read past its end
+        std::string chars;
+        while(framing.status() == parse_status::need_more and not failed())
+        {
+          chars.clear();
+          read_from_stream(chars, framing.wanted());
+          framing.feed(chars, ignore);
+          append(s, chars);
+        }
+
+        next();
+      }
+    }
+    else
+    {
+      std::string_view rest{buffer_.data() + token_begin_, buffer_.size() - token_begin_};
+      std::size_t n = framing.feed(rest, ignore);
+
+      append(s, rest.substr(0, n));
+      position_ = token_begin_ + n;
+      next();
+    }
+
+    if(framing.status() == parse_status::need_more)
+    {
+      return fail(parse_errc::unexpected_end_of_input);
+    }
+    else if(framing.status() == parse_status::error)
+    {
+      return fail(parse_errc::invalid_chunked_body, framing.error());
+    }
+
+    return *this;
+  }
+
+  inline void next()
+  {
+    begin_token();
+
+    int ch = peek_char();
+    if(ch == eof)
+    {
+      // first look for EOF, which is the empty token
+    }
+    else if(ch == ' ' or ch == '\r' or ch == '\n')
+    {
+      // look for a space, CR, or LF
+
+      consume();
+    }
+    else if(char_class_table[ch] & tspecial_char)
+    {
+      // look for a tspecial
+
+      consume();
+    }
+    else if(char_class_table[ch] & digit_char)
+    {
+      // look for a number
+
+      consume_while(digit_char);
+    }
+    else if(char_class_table[ch] & alpha_char)
+    {
+      // look for a word
+
+      consume_while(alpha_char);
+    }
+    else
+    {
+      // by default, just return the single character
+
+      consume();
+    }
+  }
+
+  std::string_view peek() const
+  {
+    if(input_)
+    {
+      return current_token_;
+    }
+
+    return std::string_view{buffer_.data() + token_begin_, position_ - token_begin_};
+  }
+
+  // whether the lexer reads from a buffer rather than a stream
+  bool is_buffered() const
+  {
+    return input_ == nullptr;
+  }
+
+  // returns the current token as a view into the input buffer
+  std::string_view peek_view() const
+  {
+    if(input_)
+    {
+      throw std::runtime_error{"lexer: string_view tokens require a buffer input"};
+    }
+
+    return peek();
+  }
+
+  static constexpr int eof = std::char_traits<char>::eof();
+
+  std::string current_token_;
+  std::istream* input_;
+  std::span<const char> buffer_;
+  std::size_t position_;
+  std::size_t token_begin_;
+  bool throws_ = true;
+  parse_result error_;
+
+  private:
+    static std::string describe(parse_errc error, std::string_view detail)
+    {
+      if(error == parse_errc::expected_literal)
+      {
+        return "Expected \"" + std::string{detail == "\r" ? "<CR>" : detail == "\n" ? "<LF>" : detail} + "\"";
+      }
+
+      return detail.empty() ? hattip::describe(error) : std::string{detail};
+    }
+
+    template<class String>
+    inline void append(String& s, std::string_view input) const
+    {
+      if constexpr(std::is_base_of_v<std::string_view, String>)
+      {
+        if(input_)
+        {
+          throw std::runtime_error{"lexer: string_view tokens require a buffer input"};
+        }
+
+        std::string_view& view = s;
+
+        if(view.empty())
+        {
+          view = input;
+        }
+        else if(not input.empty())
+        {
+          assert(view.data() + view.size() == input.data());
+          view = std::string_view{view.data(), view.size() + input.size()};
+        }
+      }
+      else
+      {
+        s += input;
+      }
+    }
+
+    template<class String>
+    inline void read_from_stream(String& s, std::size_t n)
+    {
+      if constexpr(std::is_base_of_v<std::string_view, String>)
+      {
+        throw std::runtime_error{"lexer: string_view tokens require a buffer input"};
+      }
+      else
+      {
+        if(failed())
+        {
+          return;
+        }
+
+        std::size_t old_size = s.size();
+        s.resize(old_size + n);
+        input_->read(s.data() + old_size, n);
+        position_ += input_->gcount();
+
+        if(static_cast<std::size_t>(input_->gcount()) != n)
+        {
+          s.resize(old_size + input_->gcount());
+          fail(parse_errc::unexpected_end_of_input);
+        }
+      }
+    }
+
+    inline void begin_token()
+    {
+      current_token_.clear();
+      token_begin_ = position_;
+    }
+
+    inline int peek_char()
+    {
+      if(input_)
+      {
+        return failed() ? eof : input_->peek();
+      }
+
+      return position_ == buffer_.size() ? eof : static_cast<unsigned char>(buffer_[position_]);
+    }
+
+    inline void consume()
+    {
+      if(input_)
+      {
+        current_token_.push_back(input_->get());
+      }
+
+      ++position_;
+    }
+
+    // consumes characters as long as they belong to one of the given classes
+    inline void consume_while(std::uint8_t classes)
+    {
+      if(input_)
+      {
+        for(int ch = peek_char(); ch != eof and (char_class_table[ch] & classes); ch = peek_char())
+        {
+          consume();
+        }
+      }
+      else
+      {
+        while(position_ != buffer_.size() and has_char_class(buffer_[position_], classes))
+        {
+          ++position_;
+        }
+      }
+    }
+};
+
+
+template<class String>
+struct basic_request_uri : String
+{
+  using String::String;
+
+  using allocator_type = allocator_of_t<String>;
+
+  basic_request_uri() = default;
+
+  explicit basic_request_uri(const allocator_type& alloc)
+    : String(make_string<String>(alloc))
+  {}
+
+  void reset()
+  {
+    clear_string(*this);
+  }
+
+  // Request-URI := "*" | absoluteURI | abs_path
+  // XXX for now, just accept any string not containing whitespace
+  friend lexer& operator>>(lexer& lex, basic_request_uri& self)
+  {
+    clear_string(self);
+
+    return lex.append_until(self, find_whitespace);
+  }
+
+  friend std::ostream& operator<<(std::ostream& os, const basic_request_uri& self)
+  {
+    return os << static_cast<const String&>(self);
+  }
+};
+
+using request_uri = basic_request_uri<std::string>;
+using request_uri_view = basic_request_uri<std::string_view>;
+
+
+template<class String>
+struct basic_simple_request
+{
+  using allocator_type = allocator_of_t<String>;
+
+  basic_request_uri<String> uri;
+
+  basic_simple_request() = default;
+
+  explicit basic_simple_request(const allocator_type& alloc)
+    : uri(alloc)
+  {}
+
+  void reset()
+  {
+    uri.reset();
+  }
+
+  // Simple-Request := "GET" SP Request-URI CRLF
+  friend lexer& operator>>(lexer& lex, basic_simple_request& self)
+  {
+    return lex >> "GET" >> " " >> self.uri >> "\r" >> "\n";
+  }
+
+  friend std::ostream& operator<<(std::ostream& os, const basic_simple_request& self)
+  {
+    return os << "GET" << " " << self.uri << "\r" << "\n";
+  }
+
+  template<class Writer>
+  friend void serialize(Writer& out, const basic_simple_request& self)
+  {
+    out.write("GET");
+    out.write(" ");
+    out.write(self.uri);
+    out.write("\r\n");
+  }
+};
+
+using simple_request = basic_simple_request<std::string>;
+using simple_request_view = basic_simple_request<std::string_view>;
+
+
+// LWS := [CRLF] 1*( SP | HT )
+inline bool is_lws(std::string_view s)
+{
+  std::size_t i = 0;
+
+  // skip past optional CRLF
+  if(s.size() >= 2)
+  {
+    if(s[0] == '\r' and s[1] == '\n')
+    {
+      i += 2;
+    }
+  }
+
+  // neither an empty string nor CRLF alone is lws
+  // there needs to be at least one character of white space
+  if(i == s.size())
+  {
+    return false;
+  }
+
+  for(; i != s.size(); ++i)
+  {
+    // any character besides SP or HT is not LWS
+    if(not has_char_class(s[i], lws_char))
+    {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+
+// qdtext := <any CHAR except <"> and CTLs, but including LWS>
+inline bool is_qdtext(std::string_view s)
+{
+  if(is_lws(s)) return true;
+
+  if(s == "\"") return false;
+
+  if(is_ctl(s)) return false;
+
+  return true;
+}
+
+
+template<class String>
+struct basic_quoted_string : String
+{
+  using allocator_type = allocator_of_t<String>;
+
+  basic_quoted_string() = default;
+
+  explicit basic_quoted_string(const allocator_type& alloc)
+    : String(make_string<String>(alloc))
+  {}
+
+  void reset()
+  {
+    clear_string(*this);
+  }
+
+  // Quoted-String := <"> *(qdtext) <">
+  // qdtext := <any CHAR except <"> and CTLs, but including LWS>
+  friend lexer& operator>>(lexer& lex, basic_quoted_string& self)
+  {
+    // open quote
+    if(lex.peek() != "\"")
+    {
+      lex >> "\"";
+    }
+    lex.append_to(self);
+
+    // consume text until we encounter another "
+    while(lex.peek() != "\"")
+    {
+      if(lex.peek().empty() or !is_qdtext(lex.peek()))
+      {
+        return lex.fail(parse_errc::expected_qdtext);
+      }
+
+      lex.append_to(self);
+    }
+
+    // close quote
+    lex.append_to(self);
+
+    return lex;
+  }
+};
+
+using quoted_string = basic_quoted_string<std::string>;
+using quoted_string_view = basic_quoted_string<std::string_view>;
+
+
+template<class String>
+struct basic_token : String
+{
+  using allocator_type = allocator_of_t<String>;
+
+  basic_token() = default;
+
+  explicit basic_token(const allocator_type& alloc)
+    : String(make_string<String>(alloc))
+  {}
+
+  void reset()
+  {
+    clear_string(*this);
+  }
+
   // token := 1*<any CHAR except CTLs or tspecials>
-  friend lexer& operator>>(lexer& lex, token& self)
+  friend lexer& operator>>(lexer& lex, basic_token& self)
+  {
+    // slurp text until we encounter a CTL or tspecial
+    lex.append_until(self, find_tspecial_or_ctl);
+
+    if(self.empty())
+    {
+      return lex.fail(parse_errc::expected_token);
+    }
+
+    return lex;
+  }
+};
+
+using token = basic_token<std::string>;
+using token_view = basic_token<std::string_view>;
+
+
+template<class String>
+struct basic_method
+{
+  method_id id = method_id::extension;
+
+  // the name of an extension method; empty for known methods
+  String extension_name;
+
+  using allocator_type = allocator_of_t<String>;
+
+  basic_method() = default;
+
+  explicit basic_method(const allocator_type& alloc)
+    : extension_name(make_string<String>(alloc))
+  {}
+
+  void reset()
+  {
+    id = method_id::extension;
+    clear_string(extension_name);
+  }
+
+  std::string_view name() const
+  {
+    return id == method_id::extension ? std::string_view{extension_name} : known_methods[static_cast<int>(id)];
+  }
+
+  // Method := <one of the known methods> | token
+  friend lexer& operator>>(lexer& lex, basic_method& self)
+  {
+    if(lex.peek() == "\"")
+    {
+      basic_quoted_string<String> qs{get_allocator(self.extension_name)};
+      lex >> qs;
+
+      self.id = method_id::extension;
+      self.extension_name = std::move(qs);
+    }
+    else
+    {
+      // every known method name is short enough to lex without allocating
+      basic_token<String> method_name{get_allocator(self.extension_name)};
+      lex >> method_name;
+
+      self.id = to_method_id(method_name);
+      if(self.id == method_id::extension)
+      {
+        self.extension_name = std::move(method_name);
+      }
+    }
+
+    return lex;
+  }
+
+  friend std::ostream& operator<<(std::ostream& os, const basic_method& self)
+  {
+    return os << self.name();
+  }
+
+  template<class Writer>
+  friend void serialize(Writer& out, const basic_method& self)
+  {
+    out.write(self.name());
+  }
+};
+
+using method = basic_method<std::string>;
+using method_view = basic_method<std::string_view>;
+
+
+struct http_version
+{
+  int major = 0;
+  int minor = 0;
+
+  // HTTP-Version := "HTTP" "/" 1*DIGIT "." 1*DIGIT
+  friend lexer& operator>>(lexer& lex, http_version& self)
+  {
+    return lex >> "HTTP" >> "/" >> self.major >> "." >> self.minor;
+  }
+
+  friend std::ostream& operator<<(std::ostream& os, const http_version& self)
+  {
+    return os << "HTTP" << "/" << self.major << "." << self.minor;
+  }
+
+  template<class Writer>
+  friend void serialize(Writer& out, const http_version& self)
+  {
+    out.write("HTTP/");
+    out.write(self.major);
+    out.write(".");
+    out.write(self.minor);
+  }
+};
+
+
+template<class String>
+struct basic_request_line
+{
+  using allocator_type = allocator_of_t<String>;
+
+  basic_method<String> m;
+  basic_request_uri<String> uri;
+  http_version version;
+
+  basic_request_line() = default;
+
+  explicit basic_request_line(const allocator_type& alloc)
+    : m(alloc), uri(alloc), version{}
+  {}
+
+  void reset()
+  {
+    m.reset();
+    uri.reset();
+    version = {};
+  }
+
+  // Request-Line := Method SP Request-URI SP HTTP-Version CRLF
+  friend lexer& operator>>(lexer& lex, basic_request_line& self)
+  {
+    return lex >> self.m >> " " >> self.uri >> " " >> self.version >> "\r" >> "\n";
+  }
+
+  friend std::ostream& operator<<(std::ostream& os, const basic_request_line& self)
+  {
+    return os << self.m << " " << self.uri << " " << self.version << "\r\n";
+  }
+
+  template<class Writer>
+  friend void serialize(Writer& out, const basic_request_line& self)
+  {
+    serialize(out, self.m);
+    out.write(" ");
+    out.write(self.uri);
+    out.write(" ");
+    serialize(out, self.version);
+    out.write("\r\n");
+  }
+};
+
+using request_line = basic_request_line<std::string>;
+using request_line_view = basic_request_line<std::string_view>;
+
+
+template<class String>
+using basic_field_name = basic_token<String>;
+
+using field_name = token;
+using field_name_view = token_view;
+
+
+enum class header_id : std::uint8_t
+{
+  host,
+  connection,
+  content_length,
+  content_type,
+  content_encoding,
+  transfer_encoding,
+  accept,
+  accept_encoding,
+  accept_language,
+  user_agent,
+  cookie,
+  set_cookie,
+  authorization,
+  cache_control,
+  date,
+  etag,
+  expect,
+  expires,
+  if_modified_since,
+  if_none_match,
+  keep_alive,
+  last_modified,
+  location,
+  origin,
+  pragma,
+  range,
+  referer,
+  server,
+  upgrade,
+  vary,
+  other
+};
+
+
+// the canonical spellings of the known headers' names, indexed by header_id
+constexpr std::string_view known_headers[] = {
+  "Host",
+  "Connection",
+  "Content-Length",
+  "Content-Type",
+  "Content-Encoding",
+  "Transfer-Encoding",
+  "Accept",
+  "Accept-Encoding",
+  "Accept-Language",
+  "User-Agent",
+  "Cookie",
+  "Set-Cookie",
+  "Authorization",
+  "Cache-Control",
+  "Date",
+  "ETag",
+  "Expect",
+  "Expires",
+  "If-Modified-Since",
+  "If-None-Match",
+  "Keep-Alive",
+  "Last-Modified",
+  "Location",
+  "Origin",
+  "Pragma",
+  "Range",
+  "Referer",
+  "Server",
+  "Upgrade",
+  "Vary",
+};
+
+
+// an open-addressing table of header_id + 1 keyed by ihash of the known headers' names
+constexpr std::array<std::uint8_t, 64> make_header_id_table()
+{
+  std::array<std::uint8_t, 64> result{};
+
+  for(std::size_t id = 0; id != std::size(known_headers); ++id)
+  {
+    std::size_t i = ihash(known_headers[id]) % result.size();
+    while(result[i] != 0)
+    {
+      i = (i + 1) % result.size();
+    }
+
+    result[i] = static_cast<std::uint8_t>(id + 1);
+  }
+
+  return result;
+}
+
+
+constexpr std::array<std::uint8_t, 64> header_id_table = make_header_id_table();
+
+
+// returns the id of the known header named name, ignoring case, or header_id::other
+constexpr header_id to_header_id(std::string_view name)
+{
+  for(std::size_t i = ihash(name) % header_id_table.size(); header_id_table[i] != 0; i = (i + 1) % header_id_table.size())
+  {
+    std::size_t id = header_id_table[i] - 1;
+    if(iequals(known_headers[id], name))
+    {
+      return static_cast<header_id>(id);
+    }
+  }
+
+  return header_id::other;
+}
+
+
+template<class String>
+struct basic_http_header
+{
+  using allocator_type = allocator_of_t<String>;
+
+  header_id id = header_id::other;
+
+  // the field-name as received; empty when it's the canonical spelling of a known header's name
+  basic_field_name<String> received_name;
+
+  String value;
+
+  basic_http_header() = default;
+
+  basic_http_header(const basic_http_header&) = default;
+
+  basic_http_header(basic_http_header&&) = default;
+
+  explicit basic_http_header(const allocator_type& alloc)
+    : received_name(alloc), value(make_string<String>(alloc))
+  {}
+
+  // these allow containers like std::pmr::vector to construct headers with their own allocator
+  basic_http_header(const basic_http_header& other, const allocator_type& alloc)
+    : basic_http_header(alloc)
+  {
+    *this = other;
+  }
+
+  basic_http_header(basic_http_header&& other, const allocator_type& alloc)
+    : basic_http_header(alloc)
+  {
+    *this = std::move(other);
+  }
+
+  basic_http_header& operator=(const basic_http_header&) = default;
+
+  basic_http_header& operator=(basic_http_header&&) = default;
+
+  void reset()
+  {
+    id = header_id::other;
+    received_name.reset();
+    clear_string(value);
+  }
+
+  std::string_view name() const
+  {
+    return received_name.empty() and id != header_id::other ? known_headers[static_cast<int>(id)] : std::string_view{received_name};
+  }
+
+  // identifies the header named name, storing name only if it's not a known header's canonical spelling
+  void set_name(std::string_view name)
+  {
+    id = to_header_id(name);
+
+    if(id == header_id::other or name != known_headers[static_cast<int>(id)])
+    {
+      assign_string(received_name, name);
+    }
+    else
+    {
+      clear_string(received_name);
+    }
+  }
+
+  // HTTP-header := field-name ":" [ field-value ] CRLF
+  friend lexer& operator>>(lexer& lex, basic_http_header& self)
+  {
+    if(lex.is_buffered())
+    {
+      // a view of the field-name lets us identify it before deciding whether to store it
+      field_name_view name;
+      lex >> name;
+      self.set_name(name);
+    }
+    else
+    {
+      field_name name;
+      lex >> name;
+      self.set_name(name);
+    }
+
+    lex >> ":";
+
+    // consume text until we encounter carriage return
+    lex.append_until(self.value, find_cr);
+
+    return lex >> "\r" >> "\n";
+  }
+
+  friend std::ostream& operator<<(std::ostream& os, const basic_http_header& self)
+  {
+    return os << self.name() << ":" << self.value << "\r" << "\n";
+  }
+
+  template<class Writer>
+  friend void serialize(Writer& out, const basic_http_header& self)
+  {
+    out.write(self.name());
+    out.write(":");
+    out.write(self.value);
+    out.write("\r\n");
+  }
+};
+
+using http_header = basic_http_header<std::string>;
+using http_header_view = basic_http_header<std::string_view>;
+
+
+// basic_http_headers indexes its headers by field name as they're parsed
+//
+// headers appended to body directly are indexed by the next non-const find() or update_index(),
+// while const lookups never modify the index, so that threads may share parsed headers, and scan
+// body instead when it holds headers not yet indexed. after removing or renaming headers in
+// body, call clear_index(), without which lookups would go on finding the old names
+template<class String>
+struct basic_http_headers
+{
+  using allocator_type = allocator_of_t<String>;
+
+  std::vector<basic_http_header<String>, rebind_allocator_t<String, basic_http_header<String>>> body;
+
+  basic_http_headers() = default;
+
+  explicit basic_http_headers(const allocator_type& alloc)
+    : body(alloc), spare_(alloc), slots_(alloc), next_named_(alloc)
+  {}
+
+  // removes every header, keeping them aside so that the storage of their strings can be reused
+  void reset()
+  {
+    for(auto& header : body)
+    {
+      header.reset();
+      spare_.push_back(std::move(header));
+    }
+
+    body.clear();
+    clear_index();
+  }
+
+  // appends an empty header to body, reusing one removed by reset() if possible
+  basic_http_header<String>& emplace_back()
+  {
+    if(spare_.empty())
+    {
+      return body.emplace_back();
+    }
+
+    body.push_back(std::move(spare_.back()));
+    spare_.pop_back();
+    return body.back();
+  }
+
+  // returns the first header named name, ignoring case, or nullptr if there is none
+  const basic_http_header<String>* find(std::string_view name) const
+  {
+    std::uint32_t i = first_named(name);
+    return i ? &body[i - 1] : nullptr;
+  }
+
+  basic_http_header<String>* find(std::string_view name)
+  {
+    update_index();
+
+    std::uint32_t i = first_named(name);
+    return i ? &body[i - 1] : nullptr;
+  }
+
+  // the headers sharing a single name, in the order they were received
+  class named_range
+  {
+    public:
+      class iterator
+      {
+        public:
+          using value_type = basic_http_header<String>;
+          using difference_type = std::ptrdiff_t;
+
+          iterator() = default;
+
+          iterator(const basic_http_headers* headers, std::string_view name, std::uint32_t i)
+            : headers_{headers}, name_{name}, i_{i}
+          {}
+
+          const value_type& operator*() const { return headers_->body[i_ - 1]; }
+          const value_type* operator->() const { return &**this; }
+
+          iterator& operator++()
+          {
+            i_ = headers_->next_named(name_, i_);
+            return *this;
+          }
+
+          iterator operator++(int)
+          {
+            iterator result = *this;
+            ++*this;
+            return result;
+          }
+
+          bool operator==(const iterator& other) const { return i_ == other.i_; }
+
+        private:
+          const basic_http_headers* headers_ = nullptr;
+          std::string_view name_;
+          std::uint32_t i_ = 0;
+      };
+
+      named_range(const basic_http_headers* headers, std::string_view name, std::uint32_t first)
+        : headers_{headers}, name_{name}, first_{first}
+      {}
+
+      iterator begin() const { return {headers_, name_, first_}; }
+      iterator end() const { return {headers_, name_, 0}; }
+      bool empty() const { return first_ == 0; }
+
+    private:
+      const basic_http_headers* headers_;
+      std::string_view name_;
+      std::uint32_t first_;
+  };
+
+  // returns all headers named name, ignoring case
+  //
+  // name must outlive the range
+  named_range find_all(std::string_view name) const
+  {
+    return {this, name, first_named(name)};
+  }
+
+  named_range find_all(std::string_view name)
+  {
+    update_index();
+    return {this, name, first_named(name)};
+  }
+
+  // indexes headers appended to body since the last update
+  // after removing headers or renaming them, call clear_index() first
+  void update_index()
+  {
+    if(indexed_ > body.size())
+    {
+      clear_index();
+    }
+
+    for(; indexed_ < body.size(); ++indexed_)
+    {
+      insert_into_index(static_cast<std::uint32_t>(indexed_));
+    }
+  }
+
+  void clear_index()
+  {
+    // keep the table's size, so that it needn't grow again
+    std::fill(slots_.begin(), slots_.end(), slot{0, 0, 0});
+    next_named_.clear();
+    num_names_ = 0;
+    indexed_ = 0;
+  }
+
+  // HTTP-Headers := *( General-Header
+  //                  | Request-Header
+  //                  | Entity-Header )
+  //                  CRLF
+  friend lexer& operator>>(lexer& lex, basic_http_headers& self)
+  {
+    // read headers until we encounter a carriage return
+    while(lex.peek() != "\r" and not lex.failed())
+    {
+      lex >> self.emplace_back();
+      self.update_index();
+    }
+
+    lex >> "\r" >> "\n";
+
+    return lex;
+  }
+
+  friend std::ostream& operator<<(std::ostream& os, const basic_http_headers& self)
+  {
+    for(const auto& header : self.body)
+    {
+      os << header;
+    }
+
+    return os << "\r\n";
+  }
+
+  template<class Writer>
+  friend void serialize(Writer& out, const basic_http_headers& self)
+  {
+    for(const auto& header : self.body)
+    {
+      serialize(out, header);
+    }
+
+    out.write("\r\n");
+  }
+
+  private:
+    // the index is an open-addressing hash table with a slot per distinct field name
+    // headers sharing a name are chained through next_named_
+    // indices into body are stored plus one, so that zero means "none"
+    struct slot
+    {
+      std::uint32_t hash;
+      std::uint32_t first;
+      std::uint32_t last;
+    };
+
+    // whether every header in body is indexed
+    bool indexed() const
+    {
+      return indexed_ == body.size();
+    }
+
+    std::uint32_t first_named(std::string_view name) const
+    {
+      if(not indexed())
+      {
+        return next_named(name, 0);
+      }
+
+      if(slots_.empty())
+      {
+        return 0;
+      }
+
+      std::uint32_t hash = ihash(name);
+      std::size_t mask = slots_.size() - 1;
+
+      for(std::size_t i = hash & mask; slots_[i].first != 0; i = (i + 1) & mask)
+      {
+        if(slots_[i].hash == hash and iequals(body[slots_[i].first - 1].name(), name))
+        {
+          return slots_[i].first;
+        }
+      }
+
+      return 0;
+    }
+
+    // returns the header named name after header i, both plus one, without the index if body
+    // holds headers it lacks
+    std::uint32_t next_named(std::string_view name, std::uint32_t i) const
+    {
+      if(i != 0 and indexed())
+      {
+        return next_named_[i - 1];
+      }
+
+      for(; i != body.size(); ++i)
+      {
+        if(iequals(body[i].name(), name))
+        {
+          return i + 1;
+        }
+      }
+
+      return 0;
+    }
+
+    void insert_into_index(std::uint32_t header)
+    {
+      // keep the table at most half full
+      if(2 * (num_names_ + 1) > slots_.size())
+      {
+        grow_index();
+      }
+
+      next_named_.push_back(0);
+
+      std::uint32_t hash = ihash(body[header].name());
+      std::size_t mask = slots_.size() - 1;
+
+      std::size_t i = hash & mask;
+      for(; slots_[i].first != 0; i = (i + 1) & mask)
+      {
+        if(slots_[i].hash == hash and iequals(body[slots_[i].first - 1].name(), body[header].name()))
+        {
+          // chain this header after the last one with the same name
+          next_named_[slots_[i].last - 1] = header + 1;
+          slots_[i].last = header + 1;
+          return;
+        }
+      }
+
+      slots_[i] = slot{hash, header + 1, header + 1};
+      ++num_names_;
+    }
+
+    void grow_index()
+    {
+      std::vector<slot, rebind_allocator_t<String, slot>> old_slots = std::move(slots_);
+
+      slots_.assign(std::max<std::size_t>(16, 2 * old_slots.size()), slot{0, 0, 0});
+      std::size_t mask = slots_.size() - 1;
+
+      for(const slot& s : old_slots)
+      {
+        if(s.first != 0)
+        {
+          std::size_t i = s.hash & mask;
+          while(slots_[i].first != 0)
+          {
+            i = (i + 1) & mask;
+          }
+
+          slots_[i] = s;
+        }
+      }
+    }
+
+    std::vector<basic_http_header<String>, rebind_allocator_t<String, basic_http_header<String>>> spare_;
+    std::vector<slot, rebind_allocator_t<String, slot>> slots_;
+    std::vector<std::uint32_t, rebind_allocator_t<String, std::uint32_t>> next_named_;
+    std::size_t num_names_ = 0;
+    std::size_t indexed_ = 0;
+};
+
+using http_headers = basic_http_headers<std::string>;
+using http_headers_view = basic_http_headers<std::string_view>;
+
+
+template<class String>
+struct basic_entity_body : String
+{
+  using allocator_type = allocator_of_t<String>;
+
+  basic_entity_body() = default;
+
+  explicit basic_entity_body(const allocator_type& alloc)
+    : String(make_string<String>(alloc))
+  {}
+
+  void reset()
+  {
+    clear_string(*this);
+  }
+
+  // Entity-Body := *OCTET
+  friend lexer& operator>>(lexer& lex, basic_entity_body& self)
+  {
+    // consume input until eof
+    return lex.append_until(self, find_end);
+  }
+};
+
+using entity_body = basic_entity_body<std::string>;
+using entity_body_view = basic_entity_body<std::string_view>;
+
+
+// strips leading and trailing SP and HT
+inline std::string_view trim_lws(std::string_view s)
+{
+  while(not s.empty() and has_char_class(s.front(), lws_char)) s.remove_prefix(1);
+  while(not s.empty() and has_char_class(s.back(), lws_char)) s.remove_suffix(1);
+  return s;
+}
+
+
+// parses the value of the Content-Length header, if there is one, into length
+//
+// a message may repeat Content-Length, in several headers or as a comma-separated list, only
+// with the same value each time; differing values are an error, since a recipient framing the
+// message by a different one than we do would see a different message following it
+template<class String>
+inline parse_errc parse_content_length(const basic_http_headers<String>& headers, std::optional<std::size_t>& length)
+{
+  length.reset();
+
+  for(const auto& header : headers.find_all("Content-Length"))
+  {
+    std::string_view values = header.value;
+
+    do
+    {
+      std::size_t comma = std::min(values.find(','), values.size());
+
+      // Content-Length := 1*DIGIT
+      std::string_view digits = trim_lws(values.substr(0, comma));
+      std::size_t result = 0;
+      auto [end, error] = std::from_chars(digits.data(), digits.data() + digits.size(), result);
+
+      if(digits.empty() or error != std::errc{} or end != digits.data() + digits.size() or (length and *length != result))
+      {
+        length.reset();
+        return parse_errc::invalid_content_length;
+      }
+
+      length = result;
+      values.remove_prefix(std::min(comma + 1, values.size()));
+    }
+    while(not values.empty());
+  }
+
+  return parse_errc::none;
+}
+
+
+// returns the value of the Content-Length header, if there is one
+template<class String>
+inline std::optional<std::size_t> content_length(const basic_http_headers<String>& headers)
+{
+  std::optional<std::size_t> result;
+  if(parse_errc error = parse_content_length(headers, result); error != parse_errc::none)
+  {
+    throw std::runtime_error{describe(error)};
+  }
+
+  return result;
+}
+
+
+// returns whether the last transfer-coding of the Transfer-Encoding header is "chunked"
+template<class String>
+inline bool is_chunked(const basic_http_headers<String>& headers)
+{
+  const basic_http_header<String>* last = nullptr;
+  for(const auto& header : headers.find_all("Transfer-Encoding"))
+  {
+    last = &header;
+  }
+
+  if(not last)
+  {
+    return false;
+  }
+
+  std::string_view codings = last->value;
+  std::size_t comma = codings.rfind(',');
+  if(comma != std::string_view::npos)
+  {
+    codings.remove_prefix(comma + 1);
+  }
+
+  return iequals(trim_lws(codings), "chunked");
+}
+
+
+// checks that the framing headers of a message framed as HTTP/1.1 delimit its Entity-Body
+// unambiguously (RFC 7230, section 3.3.3): a Transfer-Encoding must end with chunked, and must
+// not accompany Content-Length, since a recipient framing the message by the other header would
+// see a different message following it
+template<class String>
+inline parse_errc check_transfer_encoding(const basic_http_headers<String>& headers)
+{
+  if(headers.find("Transfer-Encoding") and (not is_chunked(headers) or headers.find("Content-Length")))
+  {
+    return parse_errc::invalid_transfer_encoding;
+  }
+
+  return parse_errc::none;
+}
+
+
+// bounds on the header lines an incremental parser accepts, beyond which parsing fails, so that a
+// peer can't make it buffer without limit
+struct header_limits
+{
+  // the size of each line of the first line, HTTP-Headers, or trailer, including its CRLF
+  std::size_t max_line_size = 8 * 1024;
+
+  // the number of HTTP-Headers, or of trailer entity-headers
+  std::size_t max_headers = 100;
+};
+
+
+// chunked_decoder decodes the chunked Transfer-Encoding incrementally from chunks of input
+// as they arrive, delivering the decoded data to a sink rather than buffering it
+//
+// Chunked-Body := *chunk last-chunk trailer CRLF
+// chunk        := chunk-size [ chunk-extension ] CRLF chunk-data CRLF
+// chunk-size   := 1*HEX
+// last-chunk   := 1*("0") [ chunk-extension ] CRLF
+// trailer      := *( entity-header CRLF )
+//
+// chunk-extensions, which begin with ";" after any SP or HT, are ignored up to their CRLF
+struct chunked_decoder
+{
+  // consumes a prefix of input, calling sink(data) with each piece of decoded chunk-data,
+  // and returns the size of the prefix
+  //
+  // consumption stops at the end of the Chunked-Body or at an error
+  template<class Sink>
+  inline std::size_t feed(std::string_view input, Sink&& sink)
+  {
+    std::size_t i = 0;
+
+    while(i != input.size() and status() == parse_status::need_more)
+    {
+      char ch = input[i];
+
+      switch(state_)
+      {
+        case state::size:
+        {
+          if(int digit = hex_value(ch); digit >= 0)
+          {
+            if(size_ > (std::numeric_limits<std::size_t>::max() >> 4))
+            {
+              fail("chunk-size is too large");
+              break;
+            }
+
+            size_ = 16 * size_ + digit;
+            ++num_digits_;
+            ++i;
+          }
+          else if(num_digits_ == 0)
+          {
+            fail("Expected chunk-size");
+          }
+          else if(ch == '\r')
+          {
+            state_ = state::size_lf;
+            ++i;
+          }
+          else
+          {
+            state_ = state::extension_lws;
+          }
+
+          break;
+        }
+
+        case state::extension_lws:
+        {
+          // only a chunk-extension, which begins with ";" after any SP or HT, may follow chunk-size
+          if(ch == ' ' or ch == '\t')
+          {
+            ++i;
+          }
+          else if(ch == ';')
+          {
+            state_ = state::extension;
+            ++i;
+          }
+          else
+          {
+            fail("Expected chunk-extension or CRLF");
+          }
+
+          break;
+        }
+
+        case state::extension:
+        {
+          i += find_cr(input.substr(i));
+          if(i != input.size())
+          {
+            state_ = state::size_lf;
+            ++i;
+          }
+
+          break;
+        }
+
+        case state::size_lf:
+        {
+          if(expect(ch, '\n'))
+          {
+            state_ = size_ == 0 ? state::trailer : state::data;
+            ++i;
+          }
+
+          break;
+        }
+
+        case state::data:
+        {
+          std::size_t n = std::min(size_, input.size() - i);
+          sink(input.substr(i, n));
+          size_ -= n;
+          i += n;
+
+          if(size_ == 0)
+          {
+            state_ = state::data_cr;
+          }
+
+          break;
+        }
+
+        case state::data_cr:
+        {
+          if(expect(ch, '\r'))
+          {
+            state_ = state::data_lf;
+            ++i;
+          }
+
+          break;
+        }
+
+        case state::data_lf:
+        {
+          if(expect(ch, '\n'))
+          {
+            state_ = state::size;
+            num_digits_ = 0;
+            ++i;
+          }
+
+          break;
+        }
+
+        case state::trailer:
+        {
+          // accumulate the current line of the trailer through its LF
+          std::size_t lf = find_first<one_of<'\n'>>(input.substr(i));
+          std::size_t n = std::min(lf + 1, input.size() - i);
+          trailer_line_.append(input.data() + i, n);
+          i += n;
+
+          if(trailer_line_.size() > limits_.max_line_size)
+          {
+            fail("Trailer line is too long");
+          }
+          else if(lf != input.size() - (i - n))
+          {
+            parse_trailer_line();
+          }
+
+          break;
+        }
+
+        default:
+        {
+          break;
+        }
+      }
+    }
+
+    return i;
+  }
+
+  inline parse_status status() const
+  {
+    switch(state_)
+    {
+      case state::done:  return parse_status::done;
+      case state::error: return parse_status::error;
+      default:           return parse_status::need_more;
+    }
+  }
+
+  // the number of characters which may be fed without reading past the end of the Chunked-Body
+  inline std::size_t wanted() const
+  {
+    return state_ == state::data ? size_ : 1;
+  }
+
+  const std::string& error() const
+  {
+    return error_;
+  }
+
+  // the entity-headers of the trailer
+  const http_headers& trailers() const
+  {
+    return trailers_;
+  }
+
+  void set_limits(header_limits limits)
+  {
+    limits_ = limits;
+  }
+
+  // prepares to decode the next Chunked-Body, keeping the limits
+  void reset()
+  {
+    state_ = state::size;
+    size_ = 0;
+    num_digits_ = 0;
+    trailer_line_.clear();
+    trailers_.reset();
+    error_.clear();
+  }
+
+  private:
+    enum class state
+    {
+      size,
+      extension_lws,
+      extension,
+      size_lf,
+      data,
+      data_cr,
+      data_lf,
+      trailer,
+      done,
+      error
+    };
+
+    static constexpr int hex_value(char ch)
+    {
+      if('0' <= ch and ch <= '9') return ch - '0';
+      if('a' <= ch and ch <= 'f') return ch - 'a' + 10;
+      if('A' <= ch and ch <= 'F') return ch - 'A' + 10;
+      return -1;
+    }
+
+    inline bool expect(char ch, char expected)
+    {
+      if(ch != expected)
+      {
+        fail(expected == '\r' ? "Expected \"<CR>\"" : "Expected \"<LF>\"");
+        return false;
+      }
+
+      return true;
+    }
+
+    inline void fail(const char* what)
+    {
+      state_ = state::error;
+      error_ = what;
+    }
+
+    inline void parse_trailer_line()
+    {
+      if(trailer_line_ == "\r\n")
+      {
+        // the empty line ends the trailer
+        state_ = state::done;
+      }
+      else if(trailers_.body.size() == limits_.max_headers)
+      {
+        fail("Too many trailer entity-headers");
+      }
+      else
+      {
+        lexer lex{std::span<const char>{trailer_line_}};
+        lex.exceptions(false);
+        lex >> trailers_.emplace_back();
+        trailers_.update_index();
+
+        if(lex.failed())
+        {
+          fail(describe(lex.result().error));
+        }
+        else if(not lex.peek().empty())
+        {
+          fail("Expected end of trailer line");
+        }
+      }
+
+      trailer_line_.clear();
+    }
+
+    state state_ = state::size;
+    std::size_t size_ = 0;
+    std::size_t num_digits_ = 0;
+    std::string trailer_line_;
+    http_headers trailers_;
+    header_limits limits_;
+    std::string error_;
+};
+
+
+// decodes the complete Chunked-Body encoded, calling sink(data) with each piece of decoded data
+template<class Sink>
+inline void decode_chunked(std::string_view encoded, Sink&& sink)
+{
+  chunked_decoder decoder;
+  decoder.feed(encoded, sink);
+
+  if(decoder.status() == parse_status::need_more)
+  {
+    throw std::runtime_error{"Unexpected end of input"};
+  }
+  else if(decoder.status() == parse_status::error)
+  {
+    throw std::runtime_error{decoder.error()};
+  }
+}
+
+
+// reads the Entity-Body following headers, which is delimited by the chunked Transfer-Encoding,
+// by Content-Length, or else by the end of input
+//
+// a chunked Entity-Body is kept encoded, exactly as received; decode it with decode_chunked()
+template<class String>
+inline lexer& read_entity_body(lexer& lex, const basic_http_headers<String>& headers, basic_entity_body<String>& body)
+{
+  if(is_chunked(headers))
+  {
+    chunked_decoder decoder;
+    return lex.read_framed(body, decoder);
+  }
+
+  std::optional<std::size_t> length;
+  if(parse_errc error = parse_content_length(headers, length); error != parse_errc::none)
   {
-    // slurp text until we encounter a CTL or tspecial
-    std::string tmp;
-    while(not is_ctl(lex.peek()) and not is_tspecial(lex.peek()))
+    return lex.fail(error);
+  }
+
+  if(length)
+  {
+    return lex.read(body, *length);
+  }
+
+  return lex >> body;
+}
+
+
+template<class String>
+struct basic_full_request
+{
+  using allocator_type = allocator_of_t<String>;
+
+  basic_request_line<String> rl;
+  basic_http_headers<String> headers;
+  basic_entity_body<String> body;
+
+  basic_full_request() = default;
+
+  explicit basic_full_request(const allocator_type& alloc)
+    : rl(alloc), headers(alloc), body(alloc)
+  {}
+
+  void reset()
+  {
+    rl.reset();
+    headers.reset();
+    body.reset();
+  }
+
+  // Full-Request := Request-Line
+  //                 HTTP-Headers
+  //                 [ Entity-Body ]
+  friend lexer& operator>>(lexer& lex, basic_full_request& self)
+  {
+    lex >> self.rl >> self.headers;
+    return read_entity_body(lex, self.headers, self.body);
+  }
+
+  friend std::ostream& operator<<(std::ostream& os, const basic_full_request& self)
+  {
+    return os << self.rl << self.headers << self.body;
+  }
+
+  template<class Writer>
+  friend void serialize(Writer& out, const basic_full_request& self)
+  {
+    serialize(out, self.rl);
+    serialize(out, self.headers);
+    out.write(self.body);
+  }
+};
+
+using full_request = basic_full_request<std::string>;
+using full_request_view = basic_full_request<std::string_view>;
+
+
+template<class String>
+struct basic_request
+{
+  using allocator_type = allocator_of_t<String>;
+
+  std::variant<basic_simple_request<String>, basic_full_request<String>> body;
+
+  basic_request() = default;
+
+  explicit basic_request(const allocator_type& alloc)
+    : body(std::in_place_index<0>, alloc), allocator_(alloc)
+  {}
+
+  allocator_type get_allocator() const
+  {
+    return allocator_.allocator;
+  }
+
+  void reset()
+  {
+    std::visit([](auto& body)
+    {
+      body.reset();
+    }, body);
+  }
+
+  // Request := Simple-Request | Full-Request
+  friend lexer& operator>>(lexer& lex, basic_request& self)
+  {
+    // parse into the Full-Request we already hold, if any, to reuse its storage
+    auto& fr = reset_or_emplace<basic_full_request<String>>(self.body, self.get_allocator());
+
+    // the first three tokens of simple & full request are the same
+    lex >> fr.rl.m >> " " >> fr.rl.uri;
+
+    // if SP and HTTP-Version come next, it's a Full-Request
+    if(lex.peek() == " ")
+    {
+      // read the rest of the Request-Line, the HTTP-Headers, and Entity-Body
+      lex >> " " >> fr.rl.version >> "\r" >> "\n" >> fr.headers;
+      read_entity_body(lex, fr.headers, fr.body);
+    }
+    else
     {
-      lex >> tmp;
-      self += tmp;
+      // else, CRLF must come next and it's a Simple-Request
+      // and method must be "GET"
+      lex >> "\r" >> "\n";
+      if(fr.rl.m.id != method_id::get)
+      {
+        return lex.fail(parse_errc::expected_literal, "GET");
+      }
+
+      basic_request_uri<String> uri = std::move(fr.rl.uri);
+      self.body.template emplace<basic_simple_request<String>>(self.get_allocator()).uri = std::move(uri);
     }
 
-    if(self.empty())
+    return lex;
+  }
+
+  friend std::ostream& operator<<(std::ostream& os, const basic_request& self)
+  {
+    std::visit([&os](const auto& body) mutable
+    {
+      os << body;
+    }, self.body);
+
+    return os;
+  }
+
+  template<class Writer>
+  friend void serialize(Writer& out, const basic_request& self)
+  {
+    std::visit([&out](const auto& body)
+    {
+      serialize(out, body);
+    }, self.body);
+  }
+
+  private:
+    [[no_unique_address]] allocator_holder<allocator_type> allocator_;
+};
+
+using request = basic_request<std::string>;
+using request_view = basic_request<std::string_view>;
+
+
+struct status_code
+{
+  int number = 0;
+
+  // Status-Code := <one of the known status codes> | three digit number
+  friend lexer& operator>>(lexer& lex, status_code& self)
+  {
+    std::size_t num_digits = lex.peek().size();
+
+    lex >> self.number;
+
+    if(!is_known_status_code(self.number) or num_digits != 3)
     {
-      throw std::runtime_error{"token: Expected at least one CHAR"};
+      return lex.fail(parse_errc::invalid_status_code);
     }
 
     return lex;
   }
+
+  friend std::ostream& operator<<(std::ostream& os, const status_code& self)
+  {
+    return os << self.number;
+  }
+
+  template<class Writer>
+  friend void serialize(Writer& out, const status_code& self)
+  {
+    out.write(self.number);
+  }
 };
 
 
-struct method : std::string
+template<class String>
+struct basic_reason_phrase : String
 {
-  // Method := <one of the known methods> | token
-  friend lexer& operator>>(lexer& lex, method& self)
+  using allocator_type = allocator_of_t<String>;
+
+  basic_reason_phrase() = default;
+
+  explicit basic_reason_phrase(const allocator_type& alloc)
+    : String(make_string<String>(alloc))
+  {}
+
+  void reset()
   {
-    if(lex.peek() == "\"")
+    clear_string(*this);
+  }
+
+  // Reason-Phrase := *<TEXT, excluding CR, LF>
+  friend lexer& operator>>(lexer& lex, basic_reason_phrase& self)
+  {
+    // slurp text until we encounter a CR or LF
+    return lex.append_until(self, find_cr_or_lf);
+  }
+};
+
+using reason_phrase = basic_reason_phrase<std::string>;
+using reason_phrase_view = basic_reason_phrase<std::string_view>;
+
+
+template<class String>
+struct basic_status_line
+{
+  using allocator_type = allocator_of_t<String>;
+
+  http_version version;
+  status_code code;
+  basic_reason_phrase<String> reason;
+
+  basic_status_line() = default;
+
+  explicit basic_status_line(const allocator_type& alloc)
+    : version{}, code{}, reason(alloc)
+  {}
+
+  void reset()
+  {
+    version = {};
+    code = {};
+    reason.reset();
+  }
+
+  // Status-Line := HTTP-Version SP Status-Code SP Reason-Phrase CRLF
+  friend lexer& operator>>(lexer& lex, basic_status_line& self)
+  {
+    return lex >> self.version >> " " >> self.code >> " " >> self.reason >> "\r" >> "\n";
+  }
+
+  friend std::ostream& operator<<(std::ostream& os, const basic_status_line& self)
+  {
+    return os << self.version << " " << self.code << " " << self.reason << "\r" << "\n";
+  }
+
+  template<class Writer>
+  friend void serialize(Writer& out, const basic_status_line& self)
+  {
+    serialize(out, self.version);
+    out.write(" ");
+    serialize(out, self.code);
+    out.write(" ");
+    out.write(self.reason);
+    out.write("\r\n");
+  }
+};
+
+using status_line = basic_status_line<std::string>;
+using status_line_view = basic_status_line<std::string_view>;
+
+
+// Simple-Response := [ Entity-Body ]
+// The optional [ ] part is redundant with Entity-Body because Entity-Body is allowed to be empty
+template<class String>
+struct basic_simple_response : basic_entity_body<String>
+{
+  using basic_entity_body<String>::basic_entity_body;
+
+  template<class Writer>
+  friend void serialize(Writer& out, const basic_simple_response& self)
+  {
+    out.write(self);
+  }
+};
+
+using simple_response = basic_simple_response<std::string>;
+using simple_response_view = basic_simple_response<std::string_view>;
+
+
+template<class String>
+struct basic_full_response
+{
+  using allocator_type = allocator_of_t<String>;
+
+  basic_status_line<String> sl;
+  basic_http_headers<String> headers;
+  basic_entity_body<String> body;
+
+  basic_full_response() = default;
+
+  explicit basic_full_response(const allocator_type& alloc)
+    : sl(alloc), headers(alloc), body(alloc)
+  {}
+
+  void reset()
+  {
+    sl.reset();
+    headers.reset();
+    body.reset();
+  }
+
+  // Full-Response := Status-Line
+  //                  HTTP-Headers
+  //                  [ Entity-Body ]
+  friend lexer& operator>>(lexer& lex, basic_full_response& self)
+  {
+    lex >> self.sl >> self.headers;
+    return read_entity_body(lex, self.headers, self.body);
+  }
+
+
+  friend std::ostream& operator<<(std::ostream& os, const basic_full_response& self)
+  {
+    return os << self.sl << self.headers << self.body;
+  }
+
+  template<class Writer>
+  friend void serialize(Writer& out, const basic_full_response& self)
+  {
+    serialize(out, self.sl);
+    serialize(out, self.headers);
+    out.write(self.body);
+  }
+};
+
+using full_response = basic_full_response<std::string>;
+using full_response_view = basic_full_response<std::string_view>;
+
+
+template<class String>
+struct basic_message
+{
+  using allocator_type = allocator_of_t<String>;
+
+  std::variant<basic_full_response<String>, basic_request<String>, basic_simple_response<String>> body;
+
+  basic_message() = default;
+
+  // parses every part of the message into memory from alloc,
+  // e.g. hattip::pmr::message msg{&arena}
+  explicit basic_message(const allocator_type& alloc)
+    : body(std::in_place_index<0>, alloc), allocator_(alloc)
+  {}
+
+  allocator_type get_allocator() const
+  {
+    return allocator_.allocator;
+  }
+
+  // empties the message, keeping the capacity of its strings and vectors
+  // so that parsing the next message into it needn't allocate
+  void reset()
+  {
+    std::visit([](auto& body)
     {
-      quoted_string qs;
-      lex >> qs;
+      body.reset();
+    }, body);
+  }
+
+  // the spec defines it as:
+  // Message := Simple-Request | Simple-Response | Full-Request | Full-Response
+  //
+  // we implement it here as:
+  // Message := Full-Reponse | Request | Simple-Response
+  friend lexer& operator>>(lexer& lex, basic_message& self)
+  {
+    if(lex.peek() == "HTTP")
+    {
+      lex >> reset_or_emplace<basic_full_response<String>>(self.body, self.get_allocator());
+    }
+    else if(!lex.peek().empty())
+    {
+      // Simple-Response is allowed to be completely empty
+      //
+      // XXX this isn't quite right because we could predict that
+      //     a Request is coming that turns out to actually be a Simple-Response
+      //
+      // to fix this, we'd need to attempt to read the Request-Line and HTTP-Headers
+      // If that failed, we'd need to backtrack somehow and parse a Simple-Response instead
+      //
+      // maybe we could throw a string containing the consumed portion of the input
+      // to reconstruct the consumed input, we could serialize the partially-successful parse
 
-      self.clear();
-      self += qs;
+      lex >> reset_or_emplace<basic_request<String>>(self.body, self.get_allocator());
     }
     else
     {
-      token extension_method_name;
-      lex >> extension_method_name;
-
-      self.clear();
-      self += extension_method_name;
+      lex >> reset_or_emplace<basic_simple_response<String>>(self.body, self.get_allocator());
     }
 
     return lex;
   }
+
+  friend std::ostream& operator<<(std::ostream& os, const basic_message& self)
+  {
+    std::visit([&os](const auto& body) mutable
+    {
+      os << body;
+    }, self.body);
+
+    return os;
+  }
+
+  template<class Writer>
+  friend void serialize(Writer& out, const basic_message& self)
+  {
+    std::visit([&out](const auto& body)
+    {
+      serialize(out, body);
+    }, self.body);
+  }
+
+  private:
+    [[no_unique_address]] allocator_holder<allocator_type> allocator_;
 };
 
+using message = basic_message<std::string>;
+using message_view = basic_message<std::string_view>;
 
-struct http_version
+
+// the grammar's types with std::pmr::string, so that a message can be parsed into an arena
+namespace pmr
 {
-  int major;
-  int minor;
 
-  // HTTP-Version := "HTTP" "/" 1*DIGIT "." 1*DIGIT
-  friend lexer& operator>>(lexer& lex, http_version& self)
+
+using request_uri = basic_request_uri<std::pmr::string>;
+using simple_request = basic_simple_request<std::pmr::string>;
+using quoted_string = basic_quoted_string<std::pmr::string>;
+using token = basic_token<std::pmr::string>;
+using method = basic_method<std::pmr::string>;
+using request_line = basic_request_line<std::pmr::string>;
+using field_name = basic_field_name<std::pmr::string>;
+using http_header = basic_http_header<std::pmr::string>;
+using http_headers = basic_http_headers<std::pmr::string>;
+using entity_body = basic_entity_body<std::pmr::string>;
+using full_request = basic_full_request<std::pmr::string>;
+using request = basic_request<std::pmr::string>;
+using reason_phrase = basic_reason_phrase<std::pmr::string>;
+using status_line = basic_status_line<std::pmr::string>;
+using simple_response = basic_simple_response<std::pmr::string>;
+using full_response = basic_full_response<std::pmr::string>;
+using message = basic_message<std::pmr::string>;
+
+
+} // end pmr
+
+
+// parses msg from input without throwing on malformed input, e.g.
+//
+//   hattip::request_view req;
+//   if(hattip::parse_result result = hattip::parse(buffer, req))
+//   {
+//     // the request occupies the first result.offset characters of buffer
+//   }
+//   else
+//   {
+//     // result.error was detected at result.offset, and req is unspecified
+//   }
+//
+// rejecting malformed input this way costs no more than parsing it, unlike catching an exception
+template<class Message>
+inline parse_result parse(std::span<const char> input, Message& msg)
+{
+  lexer lex{input};
+  lex.exceptions(false);
+  lex >> msg;
+  return lex.result();
+}
+
+
+// each grammar type's serialize(out, self) writes the pieces of its serialization, exactly as its
+// operator<< would, to a Writer with these members:
+//
+// * write(std::string_view piece), where piece refers either to the serialized object or to
+//   static storage, and so remains valid as long as the serialized object does
+// * write(int number), which writes number in decimal
+
+
+// the decimal representations of 000 through 999
+constexpr std::array<char, 3000> make_three_digit_numbers()
+{
+  std::array<char, 3000> result{};
+
+  for(int i = 0; i != 1000; ++i)
   {
-    return lex >> "HTTP" >> "/" >> self.major >> "." >> self.minor;
+    result[3 * i + 0] = '0' + i / 100;
+    result[3 * i + 1] = '0' + i / 10 % 10;
+    result[3 * i + 2] = '0' + i % 10;
   }
 
-  friend std::ostream& operator<<(std::ostream& os, const http_version& self)
+  return result;
+}
+
+constexpr std::array<char, 3000> three_digit_numbers = make_three_digit_numbers();
+
+
+// returns the decimal representation of number, which refers either to static storage
+// or, for numbers outside [0, 1000), to storage
+inline std::string_view to_decimal(int number, std::array<char, 12>& storage)
+{
+  if(0 <= number and number < 1000)
+  {
+    std::size_t num_digits = number < 10 ? 1 : number < 100 ? 2 : 3;
+    return std::string_view{three_digit_numbers.data() + 3 * number + 3 - num_digits, num_digits};
+  }
+
+  auto [end, error] = std::to_chars(storage.data(), storage.data() + storage.size(), number);
+  return std::string_view{storage.data(), static_cast<std::size_t>(end - storage.data())};
+}
+
+
+// counts the characters a serialization writes
+struct size_writer
+{
+  std::size_t size = 0;
+
+  inline void write(std::string_view piece)
+  {
+    size += piece.size();
+  }
+
+  inline void write(int number)
   {
-    return os << "HTTP" << "/" << self.major << "." << self.minor;
+    std::array<char, 12> storage;
+    size += to_decimal(number, storage).size();
   }
 };
 
 
-struct request_line
+// writes the characters of a serialization to a buffer
+struct buffer_writer
 {
-  method m;
-  request_uri uri;
-  http_version version;
+  char* position;
 
-  // Request-Line := Method SP Request-URI SP HTTP-Version CRLF
-  friend lexer& operator>>(lexer& lex, request_line& self)
+  inline void write(std::string_view piece)
   {
-    return lex >> self.m >> " " >> self.uri >> " " >> self.version >> "\r" >> "\n";
+    std::memcpy(position, piece.data(), piece.size());
+    position += piece.size();
   }
 
-  friend std::ostream& operator<<(std::ostream& os, const request_line& self)
+  inline void write(int number)
   {
-    return os << self.m << " " << self.uri << " " << self.version << "\r\n";
+    std::array<char, 12> storage;
+    write(to_decimal(number, storage));
   }
 };
 
 
-using field_name = token;
+// returns the exact number of characters serialize_into(buffer, self) writes
+template<class T>
+inline std::size_t serialized_size(const T& self)
+{
+  size_writer out;
+  serialize(out, self);
+  return out.size;
+}
 
 
-struct http_header
+// writes the serialization of self to buffer, which must have room for serialized_size(self)
+// characters, and returns the end of what was written, e.g.
+//
+//   std::string buffer(hattip::serialized_size(response), '\0');
+//   hattip::serialize_into(buffer.data(), response);
+template<class T>
+inline char* serialize_into(char* buffer, const T& self)
 {
-  field_name name;
-  std::string value;
+  buffer_writer out{buffer};
+  serialize(out, self);
+  return out.position;
+}
 
-  // HTTP-header := field-name ":" [ field-value ] CRLF
-  friend lexer& operator>>(lexer& lex, http_header& self)
+
+#if __has_include(<sys/uio.h>)
+// iovec_list gathers the pieces of serialized messages as iovecs which refer to the messages'
+// own strings, so that they can be written with a single writev() without copying, e.g.
+//
+//   hattip::iovec_list iov;
+//   serialize(iov, response);
+//   writev(fd, iov.data(), iov.size());
+//
+// the iovecs refer to the serialized messages, which must outlive them. note that writev()
+// accepts at most IOV_MAX iovecs, which a message with very many headers may exceed
+struct iovec_list
+{
+  iovec_list() = default;
+
+  // numbers are formatted into storage owned by the list, which iovecs refer to
+  iovec_list(const iovec_list&) = delete;
+  iovec_list& operator=(const iovec_list&) = delete;
+
+  inline void write(std::string_view piece)
   {
-    lex >> self.name >> ":";
+    if(piece.empty())
+    {
+      return;
+    }
 
-    // consume text until we encounter carriage return
-    std::string tmp;
-    while(lex.peek() != "\r")
+    // coalesce pieces which are adjacent in memory, e.g. in a message parsed into views
+    if(not iovecs_.empty())
     {
-      lex >> tmp;
-      self.value += tmp;
+      iovec& last = iovecs_.back();
+      if(static_cast<const char*>(last.iov_base) + last.iov_len == piece.data())
+      {
+        last.iov_len += piece.size();
+        num_bytes_ += piece.size();
+        return;
+      }
     }
 
-    return lex >> "\r" >> "\n";
+    iovecs_.push_back(iovec{const_cast<char*>(piece.data()), piece.size()});
+    num_bytes_ += piece.size();
+  }
+
+  inline void write(int number)
+  {
+    std::array<char, 12> storage;
+    std::string_view digits = to_decimal(number, storage);
+
+    if(digits.data() == storage.data())
+    {
+      // keep the formatted number for as long as the iovec refers to it
+      std::array<char, 12>& kept = numbers_.emplace_back(storage);
+      digits = std::string_view{kept.data(), digits.size()};
+    }
+
+    write(digits);
+  }
+
+  const iovec* data() const
+  {
+    return iovecs_.data();
   }
 
-  friend std::ostream& operator<<(std::ostream& os, const http_header& self)
+  // the number of iovecs
+  std::size_t size() const
   {
-    return os << self.name << ":" << self.value << "\r" << "\n";
+    return iovecs_.size();
   }
+
+  // the total length of the pieces
+  std::size_t num_bytes() const
+  {
+    return num_bytes_;
+  }
+
+  // empties the list, keeping its capacity
+  void clear()
+  {
+    iovecs_.clear();
+    numbers_.clear();
+    num_bytes_ = 0;
+  }
+
+  private:
+    std::vector<iovec> iovecs_;
+    std::deque<std::array<char, 12>> numbers_;
+    std::size_t num_bytes_ = 0;
 };
+#endif
 
 
-struct http_headers
+// how push_parser delimits an Entity-Body with neither chunked Transfer-Encoding nor Content-Length
+enum class unframed_body
 {
-  std::vector<http_header> body;
+  // the Entity-Body extends to the end of input, as operator>> parses it
+  until_end_of_input,
 
-  // HTTP-Headers := *( General-Header
-  //                  | Request-Header
-  //                  | Entity-Header )
-  //                  CRLF
-  friend lexer& operator>>(lexer& lex, http_headers& self)
+  // as HTTP/1.1 frames messages: a request, or a response with status 1xx, 204, or 304, has no
+  // Entity-Body, while any other response's extends to the end of input. a Transfer-Encoding
+  // not ending with chunked, or accompanied by Content-Length, is an error
+  http_1_1
+};
+
+
+// push_parser parses a Full-Request or Full-Response incrementally from chunks of input as
+// they arrive, e.g. from a non-blocking socket
+//
+// each line of the first line and HTTP-Headers is parsed as soon as its CRLF arrives,
+// and each byte is scanned for CRLF only once no matter how the input is split into chunks
+//
+// the Entity-Body is delimited by the chunked Transfer-Encoding or by Content-Length when
+// present; otherwise it extends to the end of the input, so the caller must call finish()
+// when the input is exhausted. a server, whose clients keep connections open, should instead
+// frame messages with set_unframed_body(unframed_body::http_1_1), and parse each message
+// pipelined after the first with next()
+//
+// by default, the Entity-Body is kept exactly as received, so a chunked Entity-Body remains
+// encoded. when a body sink is set, the Entity-Body is instead delivered to the sink piece by
+// piece as it arrives, decoded, and is not kept, so that memory use is bounded no matter the
+// size of the Entity-Body
+template<class Message>
+struct push_parser
+{
+  using body_sink = std::function<void(std::string_view)>;
+
+  // consumes the next chunk of input
+  //
+  // input fed once the current message is done is kept for the messages following it, which
+  // next() parses
+  inline parse_status feed(std::span<const char> chunk)
   {
-    // read headers until we encounter a carriage return
-    while(lex.peek() != "\r")
+    if(stage_ == stage::error)
     {
-      self.body.push_back({});
-      lex >> self.body.back();
+      return status();
     }
 
-    lex >> "\r" >> "\n";
+    compact();
 
-    return lex;
+    if(stage_ == stage::done)
+    {
+      buffer_.append(chunk.data(), chunk.size());
+    }
+    else if(stage_ == stage::body and buffer_.empty())
+    {
+      // consume the Entity-Body straight from the chunk, keeping only what follows it
+      std::size_t n = consume_body(std::string_view{chunk.data(), chunk.size()});
+      buffer_.append(chunk.data() + n, chunk.size() - n);
+    }
+    else
+    {
+      buffer_.append(chunk.data(), chunk.size());
+      parse_lines();
+    }
+
+    return status();
   }
 
-  friend std::ostream& operator<<(std::ostream& os, const http_headers& self)
+  // signals the end of input, which ends an Entity-Body without Content-Length
+  inline parse_status finish()
   {
-    for(const auto& header : self.body)
+    if(stage_ == stage::body and not chunked_ and body_remaining_.value_or(0) == 0)
     {
-      os << header;
+      stage_ = stage::done;
+    }
+    else if(stage_ != stage::done)
+    {
+      fail("Unexpected end of input");
     }
 
-    return os << "\r\n";
+    return status();
   }
-};
 
-
-struct entity_body : std::string
-{
-  // Entity-Body := *OCTET
-  friend lexer& operator>>(lexer& lex, entity_body& self)
+  inline parse_status status() const
   {
-    // consume input until eof
-    std::string tmp;
-    while(not lex.peek().empty())
+    switch(stage_)
     {
-      lex >> tmp;
-      self += tmp;
+      case stage::done:  return parse_status::done;
+      case stage::error: return parse_status::error;
+      default:           return parse_status::need_more;
     }
+  }
 
-    return lex;
+  const Message& get() const
+  {
+    return result_;
   }
-};
 
+  Message& get()
+  {
+    return result_;
+  }
 
-struct full_request
-{
-  request_line rl;
-  http_headers headers;
-  entity_body body;
+  // the entity-headers of a chunked Entity-Body's trailer
+  const http_headers& trailers() const
+  {
+    return decoder_.trailers();
+  }
 
-  // Full-Request := Request-Line
-  //                 HTTP-Headers
-  //                 [ Entity-Body ]
-  friend lexer& operator>>(lexer& lex, full_request& self)
+  const std::string& error() const
   {
-    return lex >> self.rl >> self.headers >> self.body;
+    return error_;
   }
 
-  friend std::ostream& operator<<(std::ostream& os, const full_request& self)
+  // delivers the Entity-Body to sink rather than keeping it in the result
+  void set_body_sink(body_sink sink)
   {
-    return os << self.rl << self.headers << self.body;
+    sink_ = std::move(sink);
   }
-};
 
+  void set_unframed_body(unframed_body unframed)
+  {
+    unframed_ = unframed;
+  }
 
-struct request
-{
-  std::variant<simple_request, full_request> body;
+  // bounds the lines of the first line, HTTP-Headers, and trailer, which by default are limited
+  // to header_limits{}
+  void set_limits(header_limits limits)
+  {
+    limits_ = limits;
+    decoder_.set_limits(limits);
+  }
 
-  // Request := Simple-Request | Full-Request
-  friend lexer& operator>>(lexer& lex, request& self)
+  // prepares to parse the next message, e.g. on a keep-alive connection,
+  // keeping the capacity of the previous message's storage and the settings
+  void reset()
   {
-    method m;
-    request_uri uri;
+    buffer_.clear();
+    consumed_ = 0;
+    reset_message();
+  }
 
-    // the first four tokens of simple & full request are the same
-    lex >> m >> " " >> uri >> " ";
+  // begins parsing the message following the current one from whatever input was fed after
+  // the current message, e.g. a request pipelined behind the current one, and returns its status
+  inline parse_status next()
+  {
+    reset_message();
 
-    // if HTTP-Version comes next, it's a Full-Request
-    if(lex.peek() == "HTTP")
+    if(consumed_ != buffer_.size())
     {
-      // read the HTTP-Version
-      http_version version;
-      lex >> version;
+      parse_lines();
+    }
 
-      // assemble the Request-Line
-      request_line rl{m, uri, version};
+    return status();
+  }
 
-      // read the HTTP-Headers and Entity-Body
-      http_headers headers;
-      entity_body eb;
-      lex >> headers >> eb;
+  private:
+    enum class stage
+    {
+      first_line,
+      headers,
+      body,
+      done,
+      error
+    };
+
+    inline void fail(const char* what)
+    {
+      stage_ = stage::error;
+      error_ = what;
+    }
 
-      self.body = full_request{rl, headers, eb};
+    void reset_message()
+    {
+      stage_ = stage::first_line;
+      scan_position_ = consumed_;
+      body_remaining_.reset();
+      chunked_ = false;
+      decoder_.reset();
+      result_.reset();
+      error_.clear();
     }
-    else
+
+    // discards the input parsed so far once it is at least as long as the rest, so that moving
+    // the rest costs no more than the input discarded, however many messages next() drains
+    void compact()
     {
-      // else, CRLF must come next and it's a Simple-Request
-      // and method must be "GET"
-      lex >> "\r" >> "\n";
-      if(m != "\"GET\"")
+      if(consumed_ != 0 and consumed_ >= buffer_.size() - consumed_)
       {
-        throw std::runtime_error{"Expected \"GET\""};
+        buffer_.erase(0, consumed_);
+        scan_position_ -= consumed_;
+        consumed_ = 0;
       }
-
-      self.body = simple_request{uri};
     }
 
-    return lex;
-  }
-
-  friend std::ostream& operator<<(std::ostream& os, const request& self)
-  {
-    std::visit([&os](const auto& body) mutable
+    // whether HTTP/1.1 frames the result without an Entity-Body, absent Transfer-Encoding and Content-Length
+    bool has_no_unframed_body() const
     {
-      os << body;
-    }, self.body);
-
-    return os;
-  }
-};
-
-
-struct status_code
-{
-  int number;
+      if constexpr(requires { result_.rl; })
+      {
+        return true;
+      }
+      else
+      {
+        int code = result_.sl.code.number;
+        return code / 100 == 1 or code == 204 or code == 304;
+      }
+    }
 
-  // Status-Code := <one of the known status codes> | three digit number
-  friend lexer& operator>>(lexer& lex, status_code& self)
-  {
-    std::size_t num_digits = lex.peek().size();
+    inline void parse_lines()
+    {
+      while(stage_ == stage::first_line or stage_ == stage::headers)
+      {
+        // look for the CRLF ending the current line, picking up where the last search stopped
+        std::string_view unscanned{buffer_.data() + scan_position_, buffer_.size() - scan_position_};
+        std::size_t cr = scan_position_ + find_cr(unscanned);
+        if(cr + 1 >= buffer_.size())
+        {
+          // a trailing CR may be the first half of a CRLF split across chunks
+          scan_position_ = cr;
+
+          if(buffer_.size() - consumed_ > limits_.max_line_size)
+          {
+            fail("Line is too long");
+          }
+
+          return;
+        }
+
+        if(buffer_[cr + 1] != '\n')
+        {
+          // a CR without LF is part of the line
+          scan_position_ = cr + 1;
+          continue;
+        }
+
+        std::size_t end_of_line = cr + 2;
+        std::span<const char> line{buffer_.data() + consumed_, end_of_line - consumed_};
+
+        if(line.size() > limits_.max_line_size)
+        {
+          fail("Line is too long");
+          return;
+        }
+
+        lexer lex{line};
+        lex.exceptions(false);
+
+        if(stage_ == stage::first_line)
+        {
+          if constexpr(requires { result_.rl; })
+          {
+            lex >> result_.rl;
+          }
+          else
+          {
+            lex >> result_.sl;
+          }
+
+          stage_ = stage::headers;
+        }
+        else if(line.size() == 2)
+        {
+          // the empty line ends the HTTP-Headers
+          stage_ = stage::body;
+          chunked_ = is_chunked(result_.headers);
+
+          parse_errc error = parse_errc::none;
+          if(unframed_ == unframed_body::http_1_1)
+          {
+            error = check_transfer_encoding(result_.headers);
+          }
+
+          if(error == parse_errc::none and not chunked_)
+          {
+            error = parse_content_length(result_.headers, body_remaining_);
+            if(error == parse_errc::none and not body_remaining_ and unframed_ == unframed_body::http_1_1 and has_no_unframed_body())
+            {
+              body_remaining_ = 0;
+            }
+          }
+
+          if(error != parse_errc::none)
+          {
+            lex.fail(error);
+          }
+        }
+        else if(result_.headers.body.size() == limits_.max_headers)
+        {
+          fail("Too many HTTP-Headers");
+          return;
+        }
+        else
+        {
+          lex >> result_.headers.emplace_back();
+          result_.headers.update_index();
+        }
+
+        if(lex.failed())
+        {
+          fail(describe(lex.result().error));
+          return;
+        }
+
+        consumed_ = scan_position_ = end_of_line;
+      }
 
-    lex >> self.number;
+      // whatever follows the HTTP-Headers begins the Entity-Body
+      if(stage_ == stage::body)
+      {
+        consumed_ += consume_body(std::string_view{buffer_}.substr(consumed_));
+        scan_position_ = consumed_;
+      }
+    }
 
-    if(!is_known_status_code(self.number) or num_digits != 3)
+    // consumes the part of bytes belonging to the Entity-Body, returning its size
+    inline std::size_t consume_body(std::string_view bytes)
     {
-      throw std::runtime_error{"Unexpected status code number"};
-    }
+      std::size_t n = bytes.size();
 
-    return lex;
-  }
+      if(chunked_)
+      {
+        if(sink_)
+        {
+          n = decoder_.feed(bytes, sink_);
+        }
+        else
+        {
+          n = decoder_.feed(bytes, [](std::string_view){});
+          result_.body.append(bytes.data(), n);
+        }
+
+        if(decoder_.status() == parse_status::done)
+        {
+          stage_ = stage::done;
+        }
+        else if(decoder_.status() == parse_status::error)
+        {
+          fail(decoder_.error().c_str());
+        }
+
+        return n;
+      }
 
-  friend std::ostream& operator<<(std::ostream& os, const status_code& self)
-  {
-    return os << self.number;
-  }
-};
+      if(body_remaining_)
+      {
+        n = std::min(n, *body_remaining_);
+        *body_remaining_ -= n;
+      }
 
+      if(sink_)
+      {
+        if(n != 0)
+        {
+          sink_(bytes.substr(0, n));
+        }
+      }
+      else
+      {
+        result_.body.append(bytes.data(), n);
+      }
 
-struct reason_phrase : std::string
-{
-  // Reason-Phrase := *<TEXT, excluding CR, LF>
-  friend lexer& operator>>(lexer& lex, reason_phrase& self)
-  {
-    // slurp text until we encounter a CR or LF
-    std::string tmp;
-    while(lex.peek() != "\r" and lex.peek() != "\n")
-    {
-      lex >> tmp;
-      self += tmp;
+      if(body_remaining_ == 0u)
+      {
+        stage_ = stage::done;
+      }
+
+      return n;
     }
 
-    return lex;
-  }
+    stage stage_ = stage::first_line;
+    std::string buffer_;
+    std::size_t consumed_ = 0;
+    std::size_t scan_position_ = 0;
+    std::optional<std::size_t> body_remaining_;
+    bool chunked_ = false;
+    chunked_decoder decoder_;
+    body_sink sink_;
+    unframed_body unframed_ = unframed_body::until_end_of_input;
+    header_limits limits_;
+    Message result_;
+    std::string error_;
 };
 
-
-struct status_line
+using request_parser = push_parser<full_request>;
+using response_parser = push_parser<full_response>;
+
+
+// pipeline parses back-to-back Full-Requests or Full-Responses out of a single buffer,
+// e.g. the requests a pipelining client sent on a keep-alive connection
+//
+// unlike operator>>, which reads an Entity-Body without Content-Length to the end of input,
+// pipeline frames each Entity-Body as HTTP/1.1 does, so that the message following it can be
+// parsed next:
+//
+// * a chunked Entity-Body ends with its last-chunk and trailer; any other Transfer-Encoding, or
+//   one accompanied by Content-Length, is an error
+// * otherwise, an Entity-Body ends after Content-Length characters
+// * otherwise, a request has no Entity-Body, and neither does a response with status 1xx, 204,
+//   or 304; any other response's Entity-Body extends to the end of the buffer
+//
+// no characters are copied when Message is a _view type, which then refers into the buffer
+//
+// like the lexer, malformed input throws std::runtime_error by default. with exceptions(false),
+// next() instead records the error in result() and returns 0, as it does from then on
+template<class Message>
+struct pipeline
 {
-  http_version version;
-  status_code code;
-  reason_phrase reason;
+  explicit pipeline(std::span<const char> input)
+    : input_{input.data(), input.size()},
+      consumed_{0}
+  {}
 
-  // Status-Line := HTTP-Version SP Status-Code SP Reason-Phrase CRLF
-  friend lexer& operator>>(lexer& lex, status_line& self)
+  void exceptions(bool enabled)
   {
-    return lex >> self.version >> " " >> self.code >> " " >> self.reason >> "\r" >> "\n";
+    throws_ = enabled;
   }
 
-  friend std::ostream& operator<<(std::ostream& os, const status_line& self)
+  bool exceptions() const
   {
-    return os << self.version << " " << self.code << " " << self.reason << "\r" << "\n";
+    return throws_;
   }
-};
-
-
-// Simple-Response := [ Entity-Body ]
-// The optional [ ] part is redundant with Entity-Body because Entity-Body is allowed to be empty
-struct simple_response : entity_body {};
 
-
-struct full_response 
-{
-  status_line sl;
-  http_headers headers;
-  entity_body body;
-
-  // Full-Response := Status-Line
-  //                  HTTP-Headers
-  //                  [ Entity-Body ]
-  friend lexer& operator>>(lexer& lex, full_response& self)
+  bool failed() const
   {
-    return lex >> self.sl >> self.headers >> self.body;
+    return error_.error != parse_errc::none;
   }
 
-
-  friend std::ostream& operator<<(std::ostream& os, const full_response& self)
+  // returns the first error, or else the number of characters occupied by the messages parsed
+  // so far
+  parse_result result() const
   {
-    return os << self.sl << self.headers << self.body;
+    return failed() ? error_ : parse_result{parse_errc::none, consumed_};
   }
-};
-
-
-struct message
-{
-  std::variant<full_response, request, simple_response> body;
 
-  // the spec defines it as:
-  // Message := Simple-Request | Simple-Response | Full-Request | Full-Response
+  // parses the next message into msg, returning the number of characters it occupied
   //
-  // we implement it here as:
-  // Message := Full-Reponse | Request | Simple-Response
-  friend lexer& operator>>(lexer& lex, message& self)
+  // returns 0 when the rest of the buffer holds no complete message, in which case msg is
+  // unspecified and the rest of the buffer should be kept until more input arrives, or when
+  // the input is malformed without exceptions
+  inline std::size_t next(Message& msg)
   {
-    if(lex.peek() == "HTTP")
+    if(failed())
     {
-      full_response fr;
-      lex >> fr;
-      self.body = fr;
+      return 0;
     }
-    else if(!lex.peek().empty())
+
+    std::string_view rest = remaining();
+
+    std::size_t end_of_headers = rest.find("\r\n\r\n");
+    if(end_of_headers == std::string_view::npos)
     {
-      // Simple-Response is allowed to be completely empty
-      //
-      // XXX this isn't quite right because we could predict that
-      //     a Request is coming that turns out to actually be a Simple-Response
-      //
-      // to fix this, we'd need to attempt to read the Request-Line and HTTP-Headers
-      // If that failed, we'd need to backtrack somehow and parse a Simple-Response instead
-      //
-      // maybe we could throw a string containing the consumed portion of the input
-      // to reconstruct the consumed input, we could serialize the partially-successful parse
+      return 0;
+    }
+
+    std::string_view head = rest.substr(0, end_of_headers + 4);
+    std::string_view tail = rest.substr(head.size());
 
-      request req;
-      lex >> req;
-      self.body = req;
+    msg.reset();
+
+    lexer head_lex{std::span<const char>{head}};
+    head_lex.exceptions(throws_);
+    if constexpr(requires { msg.rl; })
+    {
+      head_lex >> msg.rl >> msg.headers;
     }
     else
     {
-      simple_response sr;
-      lex >> sr;
-      self.body = sr;
+      head_lex >> msg.sl >> msg.headers;
     }
 
-    return lex;
+    if(head_lex.failed())
+    {
+      error_ = head_lex.result();
+      error_.offset += consumed_;
+      return 0;
+    }
+
+    std::optional<std::size_t> body_size;
+    if(parse_errc error = entity_body_size(msg, tail, body_size); error != parse_errc::none)
+    {
+      fail(error, head.size());
+      return 0;
+    }
+
+    if(not body_size)
+    {
+      return 0;
+    }
+
+    lexer body_lex{std::span<const char>{tail.data(), *body_size}};
+    body_lex >> msg.body;
+
+    std::size_t result = head.size() + *body_size;
+    consumed_ += result;
+    return result;
   }
 
-  friend std::ostream& operator<<(std::ostream& os, const message& self)
+  // the number of characters occupied by the messages parsed so far
+  std::size_t consumed() const
   {
-    std::visit([&os](const auto& body) mutable
-    {
-      os << body;
-    }, self.body);
+    return consumed_;
+  }
 
-    return os;
+  // the part of the buffer following the messages parsed so far
+  std::string_view remaining() const
+  {
+    return input_.substr(consumed_);
   }
+
+  private:
+    // records error, detected position characters into the rest of the buffer, or throws it
+    void fail(parse_errc error, std::size_t position)
+    {
+      if(throws_)
+      {
+        throw std::runtime_error{describe(error)};
+      }
+
+      error_ = parse_result{error, consumed_ + position};
+    }
+
+    // finds the size of msg's Entity-Body at the beginning of tail, leaving size empty when
+    // tail does not contain all of it
+    parse_errc entity_body_size(const Message& msg, std::string_view tail, std::optional<std::size_t>& size)
+    {
+      if(parse_errc error = check_transfer_encoding(msg.headers); error != parse_errc::none)
+      {
+        return error;
+      }
+
+      if(is_chunked(msg.headers))
+      {
+        chunked_decoder decoder;
+        std::size_t n = decoder.feed(tail, [](std::string_view){});
+
+        if(decoder.status() == parse_status::error)
+        {
+          // the decoder's description is more specific than the error code's
+          if(throws_)
+          {
+            throw std::runtime_error{decoder.error()};
+          }
+
+          return parse_errc::invalid_chunked_body;
+        }
+
+        size = decoder.status() == parse_status::done ? std::optional{n} : std::nullopt;
+        return parse_errc::none;
+      }
+
+      std::optional<std::size_t> length;
+      if(parse_errc error = parse_content_length(msg.headers, length); error != parse_errc::none)
+      {
+        return error;
+      }
+
+      if(length)
+      {
+        size = *length <= tail.size() ? length : std::nullopt;
+      }
+      else if constexpr(requires { msg.rl; })
+      {
+        size = 0;
+      }
+      else
+      {
+        int code = msg.sl.code.number;
+        size = (code / 100 == 1 or code == 204 or code == 304) ? 0 : tail.size();
+      }
+
+      return parse_errc::none;
+    }
+
+    std::string_view input_;
+    std::size_t consumed_;
+    bool throws_ = true;
+    parse_result error_;
 };
 
 
@@ -0,0 +1,97 @@
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include "server.hpp"
+#include "uring_server.hpp"
+
+// serves "Hello, world!" to GET requests, and echoes the Entity-Body of any other request
+//
+// usage: server [--port=N] [--shards=N] [--uring]
+//
+// each shard is an event loop pinned to its own core, one per core by default
+
+
+template<class Server>
+hattip::sharded_server<Server>* running_server = nullptr;
+
+
+template<class Server>
+void stop_running_server(int)
+{
+  running_server<Server>->stop();
+}
+
+
+void hello(const hattip::full_request& request, hattip::full_response& response)
+{
+  hattip::http_header& content_type = response.headers.emplace_back();
+  content_type.set_name("Content-Type");
+  content_type.value = "text/plain";
+
+  if(request.rl.m.id == hattip::method_id::get)
+  {
+    response.body.assign("Hello, world!\n");
+  }
+  else
+  {
+    response.body = request.body;
+  }
+}
+
+
+template<class Server>
+void serve(std::uint16_t port, unsigned num_shards)
+{
+  hattip::sharded_server<Server> server{port, hello, num_shards};
+
+  running_server<Server> = &server;
+  std::signal(SIGINT, stop_running_server<Server>);
+  std::signal(SIGTERM, stop_running_server<Server>);
+
+  std::printf("serving on port %u with %zu shards\n", server.port(), server.size());
+  server.run();
+}
+
+
+int main(int argc, char** argv)
+{
+  std::uint16_t port = 8080;
+  unsigned num_shards = std::max(1u, std::thread::hardware_concurrency());
+  bool uring = false;
+
+  for(int i = 1; i != argc; ++i)
+  {
+    std::string arg = argv[i];
+
+    if(arg.starts_with("--port="))
+    {
+      port = std::atoi(arg.c_str() + 7);
+    }
+    else if(arg.starts_with("--shards="))
+    {
+      num_shards = std::max(1, std::atoi(arg.c_str() + 9));
+    }
+    else if(arg == "--uring")
+    {
+      uring = true;
+    }
+    else
+    {
+      std::fprintf(stderr, "usage: server [--port=N] [--shards=N] [--uring]\n");
+      return 1;
+    }
+  }
+
+  if(uring)
+  {
+    serve<hattip::uring_server>(port, num_shards);
+  }
+  else
+  {
+    serve<hattip::epoll_server>(port, num_shards);
+  }
+
+  return 0;
+}
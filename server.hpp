@@ -0,0 +1,714 @@
+#pragma once
+
+#include <atomic>
+#include <cerrno>
+#include <charconv>
+#include <functional>
+#include <latch>
+#include <memory>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <sched.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include "parser.hpp"
+
+namespace hattip
+{
+
+
+// a handler fills in the response to a request
+//
+// a chunked Entity-Body arrives as received, for the handler to decode with decode_chunked().
+// the response arrives as "200 OK" with no headers or Entity-Body, and the server adds
+// Content-Length and Connection headers unless the handler does
+using handler = std::function<void(const full_request& request, full_response& response)>;
+
+
+[[noreturn]] inline void throw_system_error(const char* what)
+{
+  throw std::system_error{errno, std::generic_category(), what};
+}
+
+
+// opens a non-blocking TCP socket listening on port of every interface, or on an ephemeral
+// port when port is 0
+//
+// with reuse_port, several sockets may listen on the same port, each accepting its own share
+// of the connections the kernel balances among them
+inline int open_listener(std::uint16_t port, bool reuse_port = false)
+{
+  int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if(fd == -1)
+  {
+    throw_system_error("socket");
+  }
+
+  int one = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+  if(reuse_port and setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) == -1)
+  {
+    close(fd);
+    throw_system_error("setsockopt(SO_REUSEPORT)");
+  }
+
+  sockaddr_in address{};
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_ANY);
+  address.sin_port = htons(port);
+
+  if(bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == -1 or listen(fd, SOMAXCONN) == -1)
+  {
+    int error = errno;
+    close(fd);
+    errno = error;
+    throw_system_error("bind");
+  }
+
+  return fd;
+}
+
+
+// returns the port a socket is bound to
+inline std::uint16_t local_port(int fd)
+{
+  sockaddr_in address{};
+  socklen_t length = sizeof(address);
+  if(getsockname(fd, reinterpret_cast<sockaddr*>(&address), &length) == -1)
+  {
+    throw_system_error("getsockname");
+  }
+
+  return ntohs(address.sin_port);
+}
+
+
+// returns whether any of the comma-separated values of the named headers is value
+template<class String>
+inline bool has_header_value(const basic_http_headers<String>& headers, std::string_view name, std::string_view value)
+{
+  for(const auto& header : headers.find_all(name))
+  {
+    std::string_view values = header.value;
+    while(not values.empty())
+    {
+      std::size_t comma = std::min(values.find(','), values.size());
+      if(iequals(trim_lws(values.substr(0, comma)), value))
+      {
+        return true;
+      }
+
+      values.remove_prefix(std::min(comma + 1, values.size()));
+    }
+  }
+
+  return false;
+}
+
+
+// returns whether the client wants its connection closed after the response to request
+inline bool wants_close(const full_request& request)
+{
+  if(has_header_value(request.headers, "Connection", "close"))
+  {
+    return true;
+  }
+
+  // HTTP/1.0 connections persist only on request
+  const http_version& version = request.rl.version;
+  bool is_http_1_0 = version.major < 1 or (version.major == 1 and version.minor == 0);
+  return is_http_1_0 and not has_header_value(request.headers, "Connection", "keep-alive");
+}
+
+
+// the state of one client connection, independent of how its I/O is driven
+//
+// input received from the client is fed to its request parser, and the response to each
+// complete request, including each request the client pipelined, is queued as output
+struct connection
+{
+  explicit connection(int fd)
+    : fd{fd}
+  {
+    parser.set_unframed_body(unframed_body::http_1_1);
+  }
+
+  ~connection()
+  {
+    close(fd);
+  }
+
+  connection(const connection&) = delete;
+
+  // the output a connection may have pending before it stops answering requests, so that a
+  // client pipelining requests without reading the responses can't make us buffer without limit
+  static constexpr std::size_t max_pending_output = 1 << 20;
+
+  // parses input from the client and dispatches the requests it completes
+  //
+  // unsent is the output the caller has taken from output to send but not yet sent, which
+  // counts toward max_pending_output
+  //
+  // returns false once the connection should close after its queued output is sent,
+  // e.g. because the client asked, or sent a malformed request
+  inline bool receive(std::span<const char> input, const handler& handle, std::size_t unsent = 0)
+  {
+    if(closing)
+    {
+      return false;
+    }
+
+    parser.feed(input);
+    return dispatch(handle, unsent);
+  }
+
+  // whether a request received awaits its response until the pending output drains below
+  // max_pending_output, at which point dispatch() should be called again
+  bool backlogged() const
+  {
+    return not closing and parser.status() == parse_status::done;
+  }
+
+  // queues the response to each complete request received, including each request the client
+  // pipelined, until the pending output, with unsent as in receive(), reaches max_pending_output
+  //
+  // returns false once the connection should close after its queued output is sent
+  inline bool dispatch(const handler& handle, std::size_t unsent = 0)
+  {
+    parse_status status = parser.status();
+
+    while(status == parse_status::done)
+    {
+      if(unsent + pending_output().size() >= max_pending_output)
+      {
+        return true;
+      }
+
+      respond(handle);
+
+      if(closing)
+      {
+        return false;
+      }
+
+      status = parser.next();
+    }
+
+    if(status == parse_status::error)
+    {
+      respond_with_error(400, "Bad Request");
+      return false;
+    }
+
+    return true;
+  }
+
+  // the output queued but not yet sent
+  std::string_view pending_output() const
+  {
+    return std::string_view{output}.substr(output_sent);
+  }
+
+  // marks the first n characters of the pending output as sent
+  void sent(std::size_t n)
+  {
+    output_sent += n;
+
+    if(output_sent == output.size())
+    {
+      output.clear();
+      output_sent = 0;
+    }
+  }
+
+  int fd;
+  request_parser parser;
+  full_response response;
+  std::string output;
+  std::size_t output_sent = 0;
+  bool closing = false;
+
+  private:
+    inline void respond(const handler& handle)
+    {
+      const full_request& request = parser.get();
+
+      response.reset();
+      response.sl.version = http_version{1, 1};
+      response.sl.code.number = 200;
+      assign_string(response.sl.reason, "OK");
+
+      handle(request, response);
+
+      closing = wants_close(request) or has_header_value(response.headers, "Connection", "close");
+      queue_response();
+    }
+
+    inline void respond_with_error(int code, std::string_view reason)
+    {
+      response.reset();
+      response.sl.version = http_version{1, 1};
+      response.sl.code.number = code;
+      assign_string(response.sl.reason, reason);
+
+      closing = true;
+      queue_response();
+    }
+
+    // completes the framing of the response, and appends its serialization to the output
+    inline void queue_response()
+    {
+      if(not is_chunked(response.headers) and not response.headers.find("Content-Length"))
+      {
+        std::array<char, 24> digits;
+        auto [end, error] = std::to_chars(digits.data(), digits.data() + digits.size(), response.body.size());
+
+        http_header& header = response.headers.emplace_back();
+        header.set_name("Content-Length");
+        header.value.assign(digits.data(), end);
+      }
+
+      if(closing and not response.headers.find("Connection"))
+      {
+        http_header& header = response.headers.emplace_back();
+        header.set_name("Connection");
+        header.value = "close";
+      }
+
+      std::size_t offset = output.size();
+      output.resize(offset + serialized_size(response));
+      serialize_into(output.data() + offset, response);
+    }
+};
+
+
+// epoll_server serves the connections accepted from a listening socket on a single thread,
+// with an edge-triggered epoll loop
+//
+// each readiness notification is drained until the socket would block: reads are fed to the
+// connection's parser, which dispatches each complete request to the handler, and responses are
+// written until the socket's send buffer fills, resuming when epoll reports it writable again
+struct epoll_server
+{
+  // serves the connections accepted from listener, which the server closes when it is destroyed
+  epoll_server(int listener, handler handle)
+    : listener_{listener},
+      epoll_fd_{epoll_create1(EPOLL_CLOEXEC)},
+      wake_fd_{eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)},
+      accept_retry_fd_{timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)},
+      spare_fd_{open("/dev/null", O_RDONLY | O_CLOEXEC)},
+      handle_{std::move(handle)},
+      read_buffer_(64 * 1024)
+  {
+    if(epoll_fd_ == -1 or wake_fd_ == -1 or accept_retry_fd_ == -1 or spare_fd_ == -1)
+    {
+      throw_system_error("epoll_server");
+    }
+
+    // the listener is identified by a null pointer, the wake event by this server, and the
+    // accept retry timer by its descriptor
+    if(not watch(listener_, EPOLLIN | EPOLLET, nullptr) or
+       not watch(wake_fd_, EPOLLIN | EPOLLET, this) or
+       not watch(accept_retry_fd_, EPOLLIN | EPOLLET, &accept_retry_fd_))
+    {
+      throw_system_error("epoll_ctl");
+    }
+  }
+
+  ~epoll_server()
+  {
+    connections_.clear();
+    close(spare_fd_);
+    close(accept_retry_fd_);
+    close(wake_fd_);
+    close(epoll_fd_);
+    close(listener_);
+  }
+
+  epoll_server(const epoll_server&) = delete;
+
+  // serves connections until stop() is called
+  inline void run()
+  {
+    std::array<epoll_event, 256> events;
+
+    while(not stopping_.load(std::memory_order_relaxed))
+    {
+      int num_events = epoll_wait(epoll_fd_, events.data(), events.size(), -1);
+      if(num_events == -1)
+      {
+        if(errno == EINTR) continue;
+        throw_system_error("epoll_wait");
+      }
+
+      for(int i = 0; i != num_events; ++i)
+      {
+        void* ptr = events[i].data.ptr;
+
+        if(ptr == nullptr)
+        {
+          accept_connections();
+        }
+        else if(ptr == &accept_retry_fd_)
+        {
+          std::uint64_t expirations;
+          [[maybe_unused]] ssize_t result = read(accept_retry_fd_, &expirations, sizeof(expirations));
+          accept_connections();
+        }
+        else if(ptr != this)
+        {
+          serve(*static_cast<connection*>(ptr), events[i].events);
+        }
+      }
+    }
+  }
+
+  // makes run() return; safe to call from any thread, or from a signal handler
+  void stop()
+  {
+    stopping_.store(true, std::memory_order_relaxed);
+
+    std::uint64_t one = 1;
+    [[maybe_unused]] ssize_t result = write(wake_fd_, &one, sizeof(one));
+  }
+
+  private:
+    // returns false, with errno set, if epoll can't watch fd
+    bool watch(int fd, std::uint32_t events, void* ptr)
+    {
+      epoll_event event{};
+      event.events = events;
+      event.data.ptr = ptr;
+
+      return epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event) != -1;
+    }
+
+    inline void accept_connections()
+    {
+      for(;;)
+      {
+        int fd = accept4(listener_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if(fd == -1)
+        {
+          // EAGAIN means we've drained the backlog
+          if(errno == EAGAIN or errno == EWOULDBLOCK) return;
+
+          if(errno == EMFILE or errno == ENFILE)
+          {
+            // no further edge would report the connections left in the backlog, so refuse them
+            // instead, accepting each with the descriptor we keep spare and closing it at once
+            if(refuse_connection()) continue;
+
+            accept_later();
+            return;
+          }
+
+          // accepting again at once would fail the same way until memory is freed
+          if(errno == ENOBUFS or errno == ENOMEM)
+          {
+            accept_later();
+            return;
+          }
+
+          if(errno == EBADF or errno == EFAULT or errno == EINVAL or errno == ENOTSOCK or errno == EOPNOTSUPP)
+          {
+            throw_system_error("accept4");
+          }
+
+          // anything else concerns only the connection at hand
+          continue;
+        }
+
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        // a connection epoll can't watch, e.g. for lack of memory, is closed without affecting
+        // the others
+        auto [position, inserted] = connections_.insert_or_assign(fd, std::make_unique<connection>(fd));
+        if(not watch(fd, EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET, position->second.get()))
+        {
+          connections_.erase(position);
+        }
+      }
+    }
+
+    // accepts again once the retry timer expires, as the listener reports no further edge for
+    // the connections already waiting in its backlog
+    inline void accept_later()
+    {
+      itimerspec delay{};
+      delay.it_value.tv_nsec = 100'000'000;
+      timerfd_settime(accept_retry_fd_, 0, &delay, nullptr);
+    }
+
+    // returns false when there's no connection to refuse, or no descriptor to refuse it with
+    inline bool refuse_connection()
+    {
+      if(spare_fd_ == -1)
+      {
+        return false;
+      }
+
+      close(spare_fd_);
+      int fd = accept4(listener_, nullptr, nullptr, SOCK_CLOEXEC);
+      if(fd != -1)
+      {
+        close(fd);
+      }
+
+      spare_fd_ = open("/dev/null", O_RDONLY | O_CLOEXEC);
+      return fd != -1;
+    }
+
+    inline void serve(connection& conn, std::uint32_t events)
+    {
+      bool open = not (events & (EPOLLERR | EPOLLHUP));
+
+      // reading may have stopped at the high-water mark with input left unread, which no later
+      // EPOLLIN would report, so read on whenever the socket is ready at all
+      if(open and not conn.closing)
+      {
+        open = receive(conn);
+      }
+
+      // flush whatever we have to say, even when the client is done talking, and close once
+      // a closing connection has said it all, however many writes that took
+      if(not flush(conn) or ((not open or conn.closing) and conn.pending_output().empty()))
+      {
+        disconnect(conn);
+      }
+    }
+
+    // reads until the socket would block, or until the connection is backlogged with output
+    // the client isn't taking, returning false once the connection should close
+    inline bool receive(connection& conn)
+    {
+      for(;;)
+      {
+        if(conn.backlogged())
+        {
+          // leave further input in the socket until the output drains, which epoll reports
+          // with EPOLLOUT
+          if(not flush(conn) or not conn.dispatch(handle_))
+          {
+            return false;
+          }
+
+          if(conn.backlogged())
+          {
+            return true;
+          }
+        }
+
+        ssize_t n = read(conn.fd, read_buffer_.data(), read_buffer_.size());
+
+        if(n > 0)
+        {
+          if(not conn.receive(std::span<const char>{read_buffer_.data(), static_cast<std::size_t>(n)}, handle_))
+          {
+            return false;
+          }
+        }
+        else if(n == 0)
+        {
+          // the client closed its end
+          return false;
+        }
+        else
+        {
+          return errno == EAGAIN or errno == EWOULDBLOCK or errno == EINTR;
+        }
+      }
+    }
+
+    // writes pending output until the socket would block, returning false on error
+    inline bool flush(connection& conn)
+    {
+      while(not conn.pending_output().empty())
+      {
+        std::string_view output = conn.pending_output();
+        ssize_t n = send(conn.fd, output.data(), output.size(), MSG_NOSIGNAL);
+
+        if(n >= 0)
+        {
+          conn.sent(n);
+        }
+        else if(errno == EAGAIN or errno == EWOULDBLOCK)
+        {
+          // epoll reports the socket writable again once its send buffer drains
+          return true;
+        }
+        else if(errno != EINTR)
+        {
+          return false;
+        }
+      }
+
+      return true;
+    }
+
+    inline void disconnect(connection& conn)
+    {
+      // closing the socket removes it from the epoll set
+      connections_.erase(conn.fd);
+    }
+
+    int listener_;
+    int epoll_fd_;
+    int wake_fd_;
+    int accept_retry_fd_;
+
+    // a descriptor held in reserve, with which to refuse connections once we've run out
+    int spare_fd_;
+    handler handle_;
+    std::vector<char> read_buffer_;
+    std::unordered_map<int, std::unique_ptr<connection>> connections_;
+    std::atomic<bool> stopping_{false};
+};
+
+
+
+// sharded_server runs num_shards independent Servers (epoll_server or uring_server), each on a
+// thread pinned to its own core among those the process may run on, and each accepting from its
+// own SO_REUSEPORT listener on port, among which the kernel balances incoming connections
+//
+// shards share nothing on the request path: each owns its listener, its event loop, its
+// connections with their parsers and buffers, and its own copy of the handler, so that
+// throughput scales with cores as long as the handler keeps any state of its own per shard
+template<class Server>
+struct sharded_server
+{
+  // listens on port, or on an ephemeral port shared by every shard when port is 0
+  sharded_server(std::uint16_t port, const handler& handle, unsigned num_shards = std::thread::hardware_concurrency())
+  {
+    int first_listener = open_listener(port, true);
+    port_ = local_port(first_listener);
+
+    shards_.push_back(std::make_unique<Server>(first_listener, handle));
+    for(unsigned i = 1; i < num_shards; ++i)
+    {
+      shards_.push_back(std::make_unique<Server>(open_listener(port_, true), handle));
+    }
+  }
+
+  sharded_server(const sharded_server&) = delete;
+
+  std::uint16_t port() const
+  {
+    return port_;
+  }
+
+  std::size_t size() const
+  {
+    return shards_.size();
+  }
+
+  // serves connections on a thread per shard until stop() is called
+  //
+  // shard i is pinned to the i-th core of the calling thread's affinity mask, wrapping around
+  // when there are more shards than cores. throws std::system_error, without serving, if a
+  // shard can't be pinned
+  inline void run()
+  {
+    cpu_set_t allowed;
+    if(sched_getaffinity(0, sizeof(allowed), &allowed) == -1)
+    {
+      throw_system_error("sched_getaffinity");
+    }
+
+    std::vector<int> cores;
+    for(int core = 0; core != CPU_SETSIZE; ++core)
+    {
+      if(CPU_ISSET(core, &allowed))
+      {
+        cores.push_back(core);
+      }
+    }
+
+    // each thread waits to be pinned before serving, so that whatever its shard allocates is
+    // local to its core
+    std::latch pinned{1};
+    std::vector<std::thread> threads;
+    threads.reserve(shards_.size());
+
+    // lets the threads started go, then waits for them to return
+    auto release_and_join = [&]
+    {
+      pinned.count_down();
+
+      for(std::thread& thread : threads)
+      {
+        thread.join();
+      }
+    };
+
+    try
+    {
+      for(std::size_t i = 0; i != shards_.size(); ++i)
+      {
+        threads.emplace_back([this, i, &pinned]
+        {
+          pinned.wait();
+          shards_[i]->run();
+        });
+      }
+    }
+    catch(...)
+    {
+      // the threads already started would otherwise wait forever, and terminate the program
+      // when destroyed unjoined
+      stop();
+      release_and_join();
+      throw;
+    }
+
+    int error = 0;
+    for(std::size_t i = 0; i != threads.size() and error == 0; ++i)
+    {
+      cpu_set_t core;
+      CPU_ZERO(&core);
+      CPU_SET(cores[i % cores.size()], &core);
+      error = pthread_setaffinity_np(threads[i].native_handle(), sizeof(core), &core);
+    }
+
+    if(error != 0)
+    {
+      stop();
+    }
+
+    release_and_join();
+
+    if(error != 0)
+    {
+      throw std::system_error{error, std::generic_category(), "pthread_setaffinity_np"};
+    }
+  }
+
+  // makes run() return; safe to call from any thread, or from a signal handler
+  void stop()
+  {
+    for(auto& shard : shards_)
+    {
+      shard->stop();
+    }
+  }
+
+  private:
+    std::uint16_t port_;
+    std::vector<std::unique_ptr<Server>> shards_;
+};
+
+
+} // end hattip
+
@@ -0,0 +1,186 @@
+#include <cstdio>
+#include <sstream>
+#include <string>
+#include "count_allocations.hpp"
+#include "parser.hpp"
+
+// asserts upper bounds on how many allocations parsing and serializing make in the steady
+// state of a server, i.e. once the message being reused has grown to fit its input
+
+
+std::string typical_get =
+  "GET /index.html HTTP/1.1\r\n"
+  "Host: example.com\r\n"
+  "User-Agent: Mozilla/5.0 (X11; Linux x86_64)\r\n"
+  "Accept: text/html,application/xhtml+xml\r\n"
+  "Accept-Encoding: gzip, deflate\r\n"
+  "Cookie: session=0123456789abcdef; theme=dark\r\n"
+  "\r\n";
+
+std::string typical_post =
+  "POST /api/items HTTP/1.1\r\n"
+  "Host: example.com\r\n"
+  "Content-Type: application/json\r\n"
+  "Content-Length: 27\r\n"
+  "\r\n"
+  "{\"name\":\"hattip\",\"count\":1}";
+
+std::string chunked_post =
+  "POST /api/items HTTP/1.1\r\n"
+  "Host: example.com\r\n"
+  "Transfer-Encoding: chunked\r\n"
+  "\r\n"
+  "10\r\n{\"name\":\"hattip\"\r\n"
+  "b\r\n,\"count\":1}\r\n"
+  "0\r\n"
+  "\r\n";
+
+std::string typical_response =
+  "HTTP/1.1 200 OK\r\n"
+  "Server: hattip\r\n"
+  "Content-Type: text/html\r\n"
+  "Content-Length: 13\r\n"
+  "\r\n"
+  "Hello, world!";
+
+std::string malformed_get =
+  "GET /index.html HTTP/1.1\r\n"
+  "Host example.com\r\n"
+  "\r\n";
+
+
+bool failed = false;
+
+
+// runs operation a few times to reach the steady state, then asserts that one more run
+// makes no more than max_allocations allocations
+template<class Operation>
+void expect_at_most(const char* name, std::size_t max_allocations, Operation operation)
+{
+  for(int i = 0; i != 3; ++i)
+  {
+    operation();
+  }
+
+  allocation_counter counter;
+  operation();
+  allocation_stats stats = counter.elapsed();
+
+  bool ok = stats.count <= max_allocations;
+  failed = failed or not ok;
+
+  std::printf("%-44s %6zu allocations %8zu bytes (at most %zu)%s\n", name, stats.count, stats.bytes, max_allocations, ok ? "" : "  FAILED");
+}
+
+
+// parses input into msg, which is reused from one run to the next
+template<class Message>
+void expect_parse_at_most(const char* name, std::size_t max_allocations, const std::string& input)
+{
+  Message msg;
+
+  expect_at_most(name, max_allocations, [&]
+  {
+    hattip::lexer lex{std::span<const char>{input}};
+    msg.reset();
+    lex >> msg;
+  });
+}
+
+
+// serializes the message parsed from input into a reused stream
+template<class Message>
+void expect_serialize_at_most(const char* name, std::size_t max_allocations, const std::string& input)
+{
+  Message msg;
+  hattip::lexer lex{std::span<const char>{input}};
+  lex >> msg;
+
+  std::ostringstream os;
+
+  expect_at_most(name, max_allocations, [&]
+  {
+    os.seekp(0);
+    os << msg;
+  });
+}
+
+
+int main()
+{
+  expect_parse_at_most<hattip::request>("request/get", 0, typical_get);
+  expect_parse_at_most<hattip::request>("request/post", 0, typical_post);
+  expect_parse_at_most<hattip::request>("request/chunked", 0, chunked_post);
+  expect_parse_at_most<hattip::request_view>("request_view/get", 0, typical_get);
+  expect_parse_at_most<hattip::full_response>("full_response", 0, typical_response);
+  expect_parse_at_most<hattip::full_response_view>("full_response_view", 0, typical_response);
+  expect_parse_at_most<hattip::message>("message/get", 0, typical_get);
+  expect_parse_at_most<hattip::message>("message/response", 0, typical_response);
+
+  {
+    hattip::message_view msg;
+    expect_at_most("parse/malformed", 0, [&]
+    {
+      msg.reset();
+      hattip::parse(malformed_get, msg);
+    });
+  }
+
+  {
+    hattip::request_parser parser;
+    expect_at_most("request_parser/get", 0, [&]
+    {
+      parser.reset();
+      parser.feed(typical_get);
+    });
+  }
+
+  {
+    std::string pipelined = typical_get + typical_post + chunked_post;
+    hattip::full_request_view msg;
+    expect_at_most("pipeline/3", 0, [&]
+    {
+      hattip::pipeline<hattip::full_request_view> messages{std::span<const char>{pipelined}};
+      while(messages.next(msg) != 0);
+    });
+  }
+
+  expect_serialize_at_most<hattip::request>("serialize/request", 0, typical_get);
+  expect_serialize_at_most<hattip::full_response>("serialize/full_response", 0, typical_response);
+
+  {
+    hattip::full_response msg;
+    hattip::lexer lex{std::span<const char>{typical_response}};
+    lex >> msg;
+
+    hattip::iovec_list iov;
+    expect_at_most("serialize/iovec_list", 0, [&]
+    {
+      iov.clear();
+      serialize(iov, msg);
+    });
+  }
+
+  {
+    hattip::full_response msg;
+    hattip::lexer lex{std::span<const char>{typical_response}};
+    lex >> msg;
+
+    std::string buffer;
+    expect_at_most("serialize/serialize_into", 0, [&]
+    {
+      buffer.resize(hattip::serialized_size(msg));
+      hattip::serialize_into(buffer.data(), msg);
+    });
+  }
+
+  if(failed)
+  {
+    std::printf("FAILED\n");
+    return 1;
+  }
+
+  std::printf("OK\n");
+  return 0;
+}
+
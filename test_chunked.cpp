@@ -0,0 +1,264 @@
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include "parser.hpp"
+
+// checks that the chunked Transfer-Encoding decodes the same however its input is split, through
+// chunked_decoder, push_parser's body sink, and decode_chunked(), and that malformed
+// Chunked-Bodies fail
+
+
+bool failed = false;
+
+
+void expect(const char* name, bool ok)
+{
+  failed = failed or not ok;
+  std::printf("%-52s %s\n", name, ok ? "OK" : "FAILED");
+}
+
+
+// a Chunked-Body with chunk-extensions, LWS before one of them, and a trailer
+const std::string encoded =
+  "4;name=value\r\nWiki\r\n"
+  "5 \t;flag\r\npedia\r\n"
+  "E\r\n in\r\n\r\nchunks.\r\n"
+  "0;last\r\n"
+  "Expires: never\r\n"
+  "X-Checksum: abc\r\n"
+  "\r\n";
+
+const std::string decoded = "Wikipedia in\r\n\r\nchunks.";
+
+
+// the value of the named trailer entity-header without surrounding LWS, or "(none)"
+std::string trailer(const hattip::http_headers& trailers, std::string_view name)
+{
+  for(const auto& header : trailers.find_all(name))
+  {
+    return std::string{hattip::trim_lws(header.value)};
+  }
+
+  return "(none)";
+}
+
+
+void test_decoder_split()
+{
+  // feed the Chunked-Body, followed by the next message, in two pieces split at every position
+  std::string input = encoded + "GET / HTTP/1.1\r\n\r\n";
+  bool ok = true;
+
+  for(std::size_t split = 0; split <= input.size(); ++split)
+  {
+    hattip::chunked_decoder decoder;
+    std::string output;
+    auto sink = [&](std::string_view data){ output.append(data); };
+
+    std::size_t n = decoder.feed(std::string_view{input}.substr(0, split), sink);
+    if(decoder.status() == hattip::parse_status::need_more)
+    {
+      n += decoder.feed(std::string_view{input}.substr(n), sink);
+    }
+
+    ok = ok and decoder.status() == hattip::parse_status::done
+            and n == encoded.size()
+            and output == decoded
+            and trailer(decoder.trailers(), "Expires") == "never"
+            and trailer(decoder.trailers(), "X-Checksum") == "abc";
+  }
+
+  expect("decoder, split at every position", ok);
+}
+
+
+void test_decoder_bytewise()
+{
+  hattip::chunked_decoder decoder;
+  std::string output;
+
+  for(char c : encoded)
+  {
+    decoder.feed(std::string_view{&c, 1}, [&](std::string_view data){ output.append(data); });
+  }
+
+  bool ok = decoder.status() == hattip::parse_status::done and output == decoded and trailer(decoder.trailers(), "Expires") == "never";
+  expect("decoder, a character at a time", ok);
+}
+
+
+void test_body_sink()
+{
+  std::string input = "POST /upload HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n" + encoded + "GET /next HTTP/1.1\r\n\r\n";
+
+  // feed the request in pieces of every size up to 16
+  bool ok = true;
+  for(std::size_t piece = 1; piece <= 16; ++piece)
+  {
+    hattip::request_parser parser;
+    parser.set_unframed_body(hattip::unframed_body::http_1_1);
+
+    std::string output;
+    parser.set_body_sink([&](std::string_view data){ output.append(data); });
+
+    hattip::parse_status status = hattip::parse_status::need_more;
+    for(std::size_t i = 0; i < input.size(); i += piece)
+    {
+      status = parser.feed(std::span<const char>{input.data() + i, std::min(piece, input.size() - i)});
+    }
+
+    ok = ok and status == hattip::parse_status::done
+            and output == decoded
+            and parser.get().body.empty()
+            and trailer(parser.trailers(), "Expires") == "never"
+            and trailer(parser.trailers(), "X-Checksum") == "abc";
+
+    // the request pipelined behind the chunked one starts with no trailer
+    ok = ok and parser.next() == hattip::parse_status::done
+            and parser.get().rl.uri == "/next"
+            and trailer(parser.trailers(), "Expires") == "(none)";
+  }
+
+  expect("push_parser body sink and trailers", ok);
+}
+
+
+void test_decode_chunked()
+{
+  std::string output;
+  hattip::decode_chunked(encoded, [&](std::string_view data){ output.append(data); });
+  expect("decode_chunked", output == decoded);
+}
+
+
+void test_errors()
+{
+  const char* malformed[] = {
+    // anything but a chunk-extension or CRLF after chunk-size
+    "0x5\r\n\r\n",
+    "3zz\r\nabc\r\n0\r\n\r\n",
+    "3 x\r\nabc\r\n0\r\n\r\n",
+    // no chunk-size
+    ";ext\r\n\r\n",
+    "\r\n",
+    // chunk-data longer than chunk-size
+    "3\r\nabcd\r\n0\r\n\r\n",
+    // a chunk-size overflowing std::size_t
+    "10000000000000000\r\n",
+    // a CR without LF after chunk-size
+    "3\rabc\r\n0\r\n\r\n",
+    // a malformed trailer entity-header
+    "0\r\nExpires never\r\n\r\n"
+  };
+
+  bool ok = true;
+  for(std::string_view input : malformed)
+  {
+    hattip::chunked_decoder decoder;
+    decoder.feed(input, [](std::string_view){});
+    ok = ok and decoder.status() == hattip::parse_status::error and not decoder.error().empty();
+
+    bool threw = false;
+    try
+    {
+      hattip::decode_chunked(input, [](std::string_view){});
+    }
+    catch(const std::runtime_error&)
+    {
+      threw = true;
+    }
+    ok = ok and threw;
+  }
+
+  expect("malformed Chunked-Bodies fail", ok);
+
+  // a Chunked-Body cut short needs more input, which decode_chunked() won't get
+  hattip::chunked_decoder decoder;
+  std::string_view truncated = std::string_view{encoded}.substr(0, encoded.size() - 1);
+  decoder.feed(truncated, [](std::string_view){});
+
+  bool threw = false;
+  try
+  {
+    hattip::decode_chunked(truncated, [](std::string_view){});
+  }
+  catch(const std::runtime_error&)
+  {
+    threw = true;
+  }
+
+  expect("truncated Chunked-Body needs more input", decoder.status() == hattip::parse_status::need_more and threw);
+}
+
+
+void test_pipeline_errors()
+{
+  // a pipeline without exceptions reports where the malformed request behind a good one starts
+  std::pair<std::string, hattip::parse_errc> pipelined[] = {
+    {"POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n3zz\r\n", hattip::parse_errc::invalid_chunked_body},
+    {"POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\nContent-Length: 3\r\n\r\n", hattip::parse_errc::invalid_transfer_encoding},
+    {"POST / HTTP/1.1\r\nContent-Length: 3, 4\r\n\r\n", hattip::parse_errc::invalid_content_length},
+    {"POST / HTTP/x\r\n\r\n", hattip::parse_errc::expected_number}
+  };
+
+  bool ok = true;
+  for(auto& [malformed, error] : pipelined)
+  {
+    std::string good = "GET / HTTP/1.1\r\n\r\n";
+    std::string input = good + malformed;
+
+    hattip::pipeline<hattip::full_request_view> messages{std::span<const char>{input}};
+    messages.exceptions(false);
+    hattip::full_request_view msg;
+
+    ok = ok and messages.next(msg) == good.size()
+            and messages.next(msg) == 0
+            and messages.result().error == error
+            and messages.result().offset >= good.size()
+            and messages.next(msg) == 0;
+  }
+
+  expect("pipeline reports malformed messages", ok);
+}
+
+
+void test_trailer_limits()
+{
+  hattip::chunked_decoder decoder;
+  decoder.set_limits({64, 2});
+
+  std::string long_line = "0\r\nX-Long: " + std::string(64, 'a') + "\r\n\r\n";
+  decoder.feed(long_line, [](std::string_view){});
+  bool ok = decoder.status() == hattip::parse_status::error;
+
+  decoder.reset();
+  decoder.feed("0\r\nA: 1\r\nB: 2\r\nC: 3\r\n\r\n", [](std::string_view){});
+  ok = ok and decoder.status() == hattip::parse_status::error;
+
+  decoder.reset();
+  decoder.feed("0\r\nA: 1\r\nB: 2\r\n\r\n", [](std::string_view){});
+  ok = ok and decoder.status() == hattip::parse_status::done;
+
+  expect("trailer limits", ok);
+}
+
+
+int main()
+{
+  test_decoder_split();
+  test_decoder_bytewise();
+  test_body_sink();
+  test_decode_chunked();
+  test_errors();
+  test_pipeline_errors();
+  test_trailer_limits();
+
+  if(failed)
+  {
+    std::printf("FAILED\n");
+    return 1;
+  }
+
+  std::printf("OK\n");
+  return 0;
+}
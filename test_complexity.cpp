@@ -0,0 +1,239 @@
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <sstream>
+#include <string>
+#include "parser.hpp"
+
+// parses adversarial inputs of growing size and fails if parse time grows faster than linearly,
+// which would let a client deny service with inputs that are merely large
+//
+// each case is timed at size n and at size 8n: linear parsing takes about 8x as long at 8n,
+// while quadratic parsing would take 64x as long
+
+
+// the largest ratio of time(8n) / time(n) tolerated, leaving headroom over 8 for cache effects
+constexpr double max_ratio = 20;
+
+bool failed = false;
+
+
+// the fastest of several runs of parse(input) repeated reps times, in seconds
+double seconds(const std::function<void(const std::string&)>& parse, const std::string& input, std::size_t reps)
+{
+  using clock = std::chrono::steady_clock;
+
+  double best = 1e300;
+  for(int trial = 0; trial != 5; ++trial)
+  {
+    auto start = clock::now();
+    for(std::size_t i = 0; i != reps; ++i)
+    {
+      parse(input);
+    }
+    best = std::min(best, std::chrono::duration<double>(clock::now() - start).count());
+  }
+
+  return best;
+}
+
+
+// times parse on make_input(n) and make_input(8 * n)
+void expect_linear(const char* name, std::size_t n, const std::function<std::string(std::size_t)>& make_input, const std::function<void(const std::string&)>& parse)
+{
+  std::string small = make_input(n);
+  std::string large = make_input(8 * n);
+
+  // repeat fast parses until they take long enough to time reliably
+  std::size_t reps = 1;
+  while(seconds(parse, small, reps) < 2e-3)
+  {
+    reps *= 2;
+  }
+
+  double small_seconds = seconds(parse, small, reps) / reps;
+  double large_seconds = seconds(parse, large, reps) / reps;
+  double ratio = large_seconds / small_seconds;
+
+  bool ok = ratio < max_ratio;
+  failed = failed or not ok;
+
+  std::printf("%-36s %10zu B %10.3f ms %10zu B %10.3f ms %8.1fx%s\n", name, small.size(), 1e3 * small_seconds, large.size(), 1e3 * large_seconds, ratio, ok ? "" : "  FAILED");
+}
+
+
+// parses input as a Message with the buffer lexer
+template<class Message>
+void parse_buffer(const std::string& input)
+{
+  hattip::lexer lex{std::span<const char>{input}};
+  Message msg;
+  lex >> msg;
+}
+
+
+// parses input as a Message with the stream lexer, which lexes token by token
+template<class Message>
+void parse_stream(const std::string& input)
+{
+  std::istringstream is{input};
+  hattip::lexer lex{is};
+  Message msg;
+  lex >> msg;
+}
+
+
+// parses input as a Message without exceptions, ignoring any error
+template<class Message>
+void parse_unthrown(const std::string& input)
+{
+  Message msg;
+  hattip::parse(input, msg);
+}
+
+
+// feeds input to a request_parser a few characters at a time, as a slow client would send it,
+// with its header limits lifted so that it parses the whole input
+void parse_pushed(const std::string& input)
+{
+  hattip::request_parser parser;
+  parser.set_limits({SIZE_MAX, SIZE_MAX});
+  for(std::size_t i = 0; i < input.size(); i += 7)
+  {
+    parser.feed(std::span<const char>{input.data() + i, std::min<std::size_t>(7, input.size() - i)});
+  }
+  parser.finish();
+}
+
+
+// feeds input to a request_parser at once, as a pipelining client would send it, then drains
+// each request from it with next()
+void parse_pipelined(const std::string& input)
+{
+  hattip::request_parser parser;
+  parser.set_unframed_body(hattip::unframed_body::http_1_1);
+
+  for(hattip::parse_status status = parser.feed(std::span<const char>{input}); status == hattip::parse_status::done;)
+  {
+    status = parser.next();
+  }
+}
+
+
+std::string repeat(std::string_view s, std::size_t n)
+{
+  std::string result;
+  result.reserve(s.size() * n);
+
+  for(std::size_t i = 0; i != n; ++i)
+  {
+    result += s;
+  }
+
+  return result;
+}
+
+
+int main()
+{
+  auto huge_header_value = [](std::size_t n)
+  {
+    return "GET / HTTP/1.1\r\nX-Huge: " + repeat("a;", n) + "\r\n\r\n";
+  };
+
+  auto huge_uri = [](std::size_t n)
+  {
+    return "GET /" + repeat("a/", n) + " HTTP/1.1\r\n\r\n";
+  };
+
+  auto huge_method = [](std::size_t n)
+  {
+    return repeat("X", n) + " / HTTP/1.1\r\n\r\n";
+  };
+
+  auto many_headers = [](std::size_t n)
+  {
+    std::string headers;
+    for(std::size_t i = 0; i != n; ++i)
+    {
+      headers += "X-" + std::to_string(i % 1000) + ": v\r\n";
+    }
+
+    return "GET / HTTP/1.1\r\n" + headers + "\r\n";
+  };
+
+  auto many_identical_headers = [](std::size_t n)
+  {
+    return "GET / HTTP/1.1\r\n" + repeat("Cookie: a=b\r\n", n) + "\r\n";
+  };
+
+  auto many_tiny_tokens = [](std::size_t n)
+  {
+    // without Content-Length, the Entity-Body extends to the end of input
+    return "POST / HTTP/1.1\r\n\r\n" + repeat("a;", n);
+  };
+
+  auto many_tiny_chunks = [](std::size_t n)
+  {
+    return "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n" + repeat("1;x\r\na\r\n", n) + "0\r\n\r\n";
+  };
+
+  auto many_pipelined_requests = [](std::size_t n)
+  {
+    return repeat("GET / HTTP/1.1\r\n\r\n", n);
+  };
+
+  auto long_digit_run = [](std::size_t n)
+  {
+    return "GET / HTTP/1." + repeat("1", n) + "\r\n\r\n";
+  };
+
+  auto huge_status_code = [](std::size_t n)
+  {
+    return "HTTP/1.1 " + repeat("2", n) + " OK\r\n\r\n";
+  };
+
+  auto huge_reason_phrase = [](std::size_t n)
+  {
+    return "HTTP/1.1 200 " + repeat("O K", n) + "\r\n\r\n";
+  };
+
+  auto deep_quoted_string = [](std::size_t n)
+  {
+    return "\"" + repeat("a \t", n) + "\"";
+  };
+
+  std::size_t n = 1 << 16;
+
+  expect_linear("huge header value (buffer)", n, huge_header_value, parse_buffer<hattip::message_view>);
+  expect_linear("huge header value (stream)", n, huge_header_value, parse_stream<hattip::message>);
+  expect_linear("huge header value (push)", n, huge_header_value, parse_pushed);
+  expect_linear("huge Request-URI (buffer)", n, huge_uri, parse_buffer<hattip::message>);
+  expect_linear("huge Request-URI (stream)", n, huge_uri, parse_stream<hattip::message>);
+  expect_linear("huge extension method (stream)", n, huge_method, parse_stream<hattip::message>);
+  expect_linear("many headers (buffer)", n / 8, many_headers, parse_buffer<hattip::message>);
+  expect_linear("many identical headers (buffer)", n / 8, many_identical_headers, parse_buffer<hattip::message>);
+  expect_linear("many identical headers (push)", n / 8, many_identical_headers, parse_pushed);
+  expect_linear("many tiny tokens (buffer)", n, many_tiny_tokens, parse_buffer<hattip::message>);
+  expect_linear("many tiny tokens (stream)", n, many_tiny_tokens, parse_stream<hattip::message>);
+  expect_linear("many tiny chunks (buffer)", n / 4, many_tiny_chunks, parse_buffer<hattip::message>);
+  expect_linear("many tiny chunks (stream)", n / 4, many_tiny_chunks, parse_stream<hattip::message>);
+  expect_linear("many tiny chunks (push)", n / 4, many_tiny_chunks, parse_pushed);
+  expect_linear("many pipelined requests (push)", n / 4, many_pipelined_requests, parse_pipelined);
+  expect_linear("long digit run (unthrown)", n, long_digit_run, parse_unthrown<hattip::message>);
+  expect_linear("huge status code (unthrown)", n, huge_status_code, parse_unthrown<hattip::message>);
+  expect_linear("huge reason phrase (buffer)", n, huge_reason_phrase, parse_buffer<hattip::message>);
+  expect_linear("huge reason phrase (stream)", n, huge_reason_phrase, parse_stream<hattip::message>);
+  expect_linear("deep quoted string (buffer)", n, deep_quoted_string, parse_buffer<hattip::quoted_string>);
+  expect_linear("deep quoted string (stream)", n, deep_quoted_string, parse_stream<hattip::quoted_string>);
+
+  if(failed)
+  {
+    std::printf("FAILED\n");
+    return 1;
+  }
+
+  std::printf("OK\n");
+  return 0;
+}
+
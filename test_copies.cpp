@@ -0,0 +1,94 @@
+#include <sstream>
+#include "count_allocations.hpp"
+#include "parser.hpp"
+
+
+// a std::string which counts how many times it is copied
+struct counting_string : std::string
+{
+  using std::string::string;
+
+  static inline int num_copies = 0;
+
+  counting_string() = default;
+
+  counting_string(const counting_string& other)
+    : std::string(other)
+  {
+    ++num_copies;
+  }
+
+  counting_string(const counting_string& other, const allocator_type& alloc)
+    : std::string(other, alloc)
+  {
+    ++num_copies;
+  }
+
+  counting_string(counting_string&&) = default;
+
+  counting_string& operator=(const counting_string& other)
+  {
+    ++num_copies;
+    std::string::operator=(other);
+    return *this;
+  }
+
+  counting_string& operator=(counting_string&&) = default;
+};
+
+
+template<class Message>
+void test(const std::string& input, std::size_t body_size)
+{
+  counting_string::num_copies = 0;
+  std::size_t bytes_before = num_bytes_allocated;
+
+  hattip::lexer lex{std::span<const char>{input}};
+  Message msg;
+  lex >> msg;
+
+  std::size_t bytes_allocated = num_bytes_allocated - bytes_before;
+
+  // nothing was copied, and the body was allocated only once
+  assert(counting_string::num_copies == 0);
+  assert(bytes_allocated < body_size + body_size / 2);
+
+  // parse the input again into the same message, which reuses the body's storage
+  // after the second time, parsing allocates nothing at all
+  for(int i = 0; i != 2; ++i)
+  {
+    bytes_before = num_bytes_allocated;
+
+    hattip::lexer again{std::span<const char>{input}};
+    msg.reset();
+    again >> msg;
+
+    assert(counting_string::num_copies == 0);
+    assert(num_bytes_allocated - bytes_before < body_size / 2);
+  }
+
+  assert(num_bytes_allocated == bytes_before);
+
+  std::stringstream regenerated_input;
+  regenerated_input << msg;
+  assert(regenerated_input.str() == input);
+}
+
+
+int main()
+{
+  std::size_t body_size = 8 << 20;
+  std::string body(body_size, 'x');
+
+  std::string request = "POST /upload HTTP/1.1\r\nHost: example.com\r\nContent-Type: application/octet-stream\r\n\r\n" + body;
+  std::string response = "HTTP/1.1 200 OK\r\nServer: hattip\r\n\r\n" + body;
+
+  test<hattip::basic_message<counting_string>>(request, body_size);
+  test<hattip::basic_message<counting_string>>(response, body_size);
+  test<hattip::basic_request<counting_string>>(request, body_size);
+  test<hattip::basic_full_response<counting_string>>(response, body_size);
+
+  std::cout << "OK" << std::endl;
+
+  return 0;
+}
@@ -0,0 +1,281 @@
+#include <chrono>
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include "executor.hpp"
+
+// checks that chase_lev_deque hands each element to exactly one thread, and that
+// work_stealing_executor runs every task, including those tasks submit, exactly once
+
+
+bool failed = false;
+
+
+void expect(const char* name, bool ok)
+{
+  failed = failed or not ok;
+  std::printf("%-52s %s\n", name, ok ? "OK" : "FAILED");
+}
+
+
+// waits until counter reaches n, giving up after a few seconds
+bool wait_for(const std::atomic<std::size_t>& counter, std::size_t n)
+{
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+
+  while(counter.load() != n and std::chrono::steady_clock::now() < deadline)
+  {
+    std::this_thread::yield();
+  }
+
+  return counter.load() == n;
+}
+
+
+void test_deque_alone()
+{
+  // a small initial capacity makes the deque grow several times
+  hattip::chase_lev_deque<int> deque{4};
+  for(int i = 0; i != 1000; ++i)
+  {
+    deque.push(i);
+  }
+
+  bool ok = deque.steal() == 0 and deque.steal() == 1;
+  for(int i = 999; i != 1; --i)
+  {
+    ok = ok and deque.pop() == i;
+  }
+  ok = ok and not deque.pop() and not deque.steal() and deque.empty();
+
+  expect("deque pops newest, steals oldest, and grows", ok);
+}
+
+
+void test_deque_thieves()
+{
+  constexpr int n = 1'000'000;
+  constexpr int num_thieves = 3;
+
+  hattip::chase_lev_deque<int> deque{16};
+  std::vector<std::atomic<int>> taken(n);
+  std::atomic<bool> done{false};
+
+  std::vector<std::thread> thieves;
+  for(int i = 0; i != num_thieves; ++i)
+  {
+    thieves.emplace_back([&]
+    {
+      while(not done.load() or not deque.empty())
+      {
+        if(std::optional<int> x = deque.steal())
+        {
+          taken[*x].fetch_add(1);
+        }
+      }
+    });
+  }
+
+  // the owner pops every third element it pushes, racing the thieves for the last ones
+  for(int i = 0; i != n; ++i)
+  {
+    deque.push(i);
+
+    if(i % 3 == 0)
+    {
+      if(std::optional<int> x = deque.pop())
+      {
+        taken[*x].fetch_add(1);
+      }
+    }
+  }
+
+  while(std::optional<int> x = deque.pop())
+  {
+    taken[*x].fetch_add(1);
+  }
+
+  done.store(true);
+  for(auto& thief : thieves)
+  {
+    thief.join();
+  }
+
+  bool ok = true;
+  for(auto& count : taken)
+  {
+    ok = ok and count.load() == 1;
+  }
+
+  expect("deque hands each element to exactly one thread", ok);
+}
+
+
+void spawn_tree(hattip::work_stealing_executor& executor, std::atomic<std::size_t>& count, int depth)
+{
+  count.fetch_add(1);
+
+  if(depth != 0)
+  {
+    executor.execute([&, depth]{ spawn_tree(executor, count, depth - 1); });
+    executor.execute([&, depth]{ spawn_tree(executor, count, depth - 1); });
+  }
+}
+
+
+void test_executor()
+{
+  // outlives the executor, whose destructor waits for the task that reads it
+  std::atomic<bool> release{false};
+
+  hattip::work_stealing_executor executor{4};
+
+  {
+    std::atomic<std::size_t> count{0};
+    for(int i = 0; i != 10000; ++i)
+    {
+      executor.execute([&]{ count.fetch_add(1); });
+    }
+
+    expect("executor runs tasks submitted from outside", wait_for(count, 10000));
+  }
+
+  {
+    // tasks submitted by tasks go onto their worker's deque, for idle workers to steal
+    std::atomic<std::size_t> count{0};
+    executor.execute([&]{ spawn_tree(executor, count, 14); });
+
+    expect("executor runs tasks submitted by tasks", wait_for(count, (1 << 15) - 1));
+  }
+
+  {
+    // while one worker is stuck in a slow handler, the others keep running tasks
+    std::atomic<std::size_t> count{0};
+
+    executor.execute([&]
+    {
+      while(not release.load())
+      {
+        std::this_thread::yield();
+      }
+    });
+
+    for(int i = 0; i != 1000; ++i)
+    {
+      executor.execute([&]{ count.fetch_add(1); });
+    }
+
+    expect("a slow task doesn't stall the others", wait_for(count, 1000));
+    release.store(true);
+  }
+
+  {
+    std::string input = "POST /echo HTTP/1.1\r\nContent-Length: 5\r\n\r\nhello";
+    hattip::full_request request;
+    hattip::lexer lex{std::span<const char>{input}};
+    lex >> request;
+
+    std::string output;
+    std::atomic<std::size_t> completed{0};
+
+    auto echo = [](const hattip::full_request& request, hattip::full_response& response)
+    {
+      response.sl.version = {1, 1};
+      response.sl.code.number = 200;
+      hattip::assign_string(response.sl.reason, "OK");
+      response.body.assign(request.body);
+    };
+
+    executor.submit(request, echo, [&](const hattip::full_response& response)
+    {
+      output.resize(hattip::serialized_size(response));
+      hattip::serialize_into(output.data(), response);
+      completed.fetch_add(1);
+    });
+
+    bool ok = wait_for(completed, 1) and output == "HTTP/1.1 200 OK\r\n\r\nhello";
+    expect("submit() handles a request and completes its response", ok);
+
+    auto throwing = [](const hattip::full_request&, hattip::full_response&)
+    {
+      throw std::runtime_error{"handler failed"};
+    };
+
+    executor.submit(request, throwing, [&](const hattip::full_response& response)
+    {
+      output = std::to_string(response.sl.code.number);
+      completed.fetch_add(1);
+    });
+
+    ok = wait_for(completed, 2) and output == "500";
+    expect("submit() answers a throwing handler with 500", ok);
+  }
+}
+
+
+void test_stealing_submitted()
+{
+  // outlives the executor, whose destructor waits for the tasks that read it
+  std::atomic<bool> release{false};
+
+  hattip::work_stealing_executor executor{2};
+
+  // occupy both workers, so that the requests submitted meanwhile queue up behind them
+  std::atomic<std::size_t> blocked{0};
+  for(int i = 0; i != 2; ++i)
+  {
+    executor.execute([&]
+    {
+      blocked.fetch_add(1);
+      while(not release.load())
+      {
+        std::this_thread::yield();
+      }
+    });
+  }
+  bool ok = wait_for(blocked, 2);
+
+  std::string input = "GET /slow HTTP/1.1\r\n\r\n";
+  hattip::full_request request;
+  hattip::lexer lex{std::span<const char>{input}};
+  lex >> request;
+
+  auto slow = [](const hattip::full_request&, hattip::full_response&)
+  {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  };
+
+  std::atomic<std::size_t> completed{0};
+  for(int i = 0; i != 32; ++i)
+  {
+    executor.submit(request, slow, [&](const hattip::full_response&){ completed.fetch_add(1); });
+  }
+
+  // whichever worker is freed first moves the queued requests onto its deque, from which the
+  // other steals them
+  release.store(true);
+
+  ok = ok and wait_for(completed, 32) and executor.steals() != 0;
+  expect("requests submitted from outside are stolen", ok);
+}
+
+
+int main()
+{
+  test_deque_alone();
+  test_deque_thieves();
+  test_executor();
+  test_stealing_submitted();
+
+  if(failed)
+  {
+    std::printf("FAILED\n");
+    return 1;
+  }
+
+  std::printf("OK\n");
+  return 0;
+}
+
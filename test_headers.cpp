@@ -0,0 +1,144 @@
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+#include "parser.hpp"
+
+// checks that http_headers finds headers by field name, ignoring case, whether they were parsed
+// or appended to body directly, that clear_index() lets lookups see headers renamed in body, and
+// that threads may look up shared headers at once
+
+
+bool failed = false;
+
+
+void expect(const char* name, bool ok)
+{
+  failed = failed or not ok;
+  std::printf("%-52s %s\n", name, ok ? "OK" : "FAILED");
+}
+
+
+hattip::http_headers parse_headers(std::string_view input)
+{
+  hattip::http_headers headers;
+  hattip::lexer lex{std::span<const char>{input}};
+  lex >> headers;
+  return headers;
+}
+
+
+// the values of the headers named name, separated by commas
+std::string values(const hattip::http_headers& headers, std::string_view name)
+{
+  std::string result;
+  for(const auto& header : headers.find_all(name))
+  {
+    result += result.empty() ? "" : ",";
+    result += hattip::trim_lws(header.value);
+  }
+
+  return result;
+}
+
+
+void test_parsed()
+{
+  const hattip::http_headers headers = parse_headers("Host: a\r\nAccept: b\r\naccept: c\r\n\r\n");
+
+  bool ok = headers.find("HOST") and headers.find("HOST")->value == " a"
+            and not headers.find("Connection")
+            and values(headers, "ACCEPT") == "b,c";
+
+  expect("parsed headers, ignoring case", ok);
+}
+
+
+void test_appended()
+{
+  hattip::http_headers headers = parse_headers("Accept: b\r\n\r\n");
+
+  hattip::http_header& header = headers.emplace_back();
+  header.set_name("Accept");
+  header.value = "c";
+
+  // const lookups see the appended header without indexing it
+  const hattip::http_headers& shared = headers;
+  bool ok = shared.find("accept") == &headers.body[0] and values(shared, "accept") == "b,c";
+
+  // and so do lookups that index it
+  ok = ok and headers.find("accept") == &headers.body[0] and values(shared, "accept") == "b,c";
+
+  expect("headers appended to body", ok);
+}
+
+
+void test_renamed()
+{
+  hattip::http_headers headers = parse_headers("Accept: b\r\nX-Old: c\r\n\r\n");
+
+  // renaming a header in place leaves the index stale, missing it under its new name, until
+  // the index is cleared
+  headers.body[1].set_name("Accept");
+  bool stale = values(headers, "Accept") == "b";
+
+  headers.clear_index();
+  bool ok = values(headers, "Accept") == "b,c" and not headers.find("X-Old");
+
+  expect("clear_index() after renaming headers in body", stale and ok);
+}
+
+
+void test_shared()
+{
+  std::string input;
+  for(int i = 0; i != 64; ++i)
+  {
+    input += "X-Header-" + std::to_string(i) + ": " + std::to_string(i) + "\r\n";
+  }
+  input += "\r\n";
+
+  const hattip::http_headers headers = parse_headers(input);
+
+  // const lookups only read the index, so threads may share it
+  std::vector<std::thread> threads;
+  std::vector<char> ok(4, true);
+
+  for(std::size_t t = 0; t != ok.size(); ++t)
+  {
+    threads.emplace_back([&, t]
+    {
+      for(int n = 0; n != 1000; ++n)
+      {
+        int i = (n + t) % 64;
+        auto* header = headers.find("x-header-" + std::to_string(i));
+        ok[t] = ok[t] and header and hattip::trim_lws(header->value) == std::to_string(i);
+      }
+    });
+  }
+
+  for(std::thread& thread : threads)
+  {
+    thread.join();
+  }
+
+  expect("threads looking up shared headers", ok == std::vector<char>(ok.size(), true));
+}
+
+
+int main()
+{
+  test_parsed();
+  test_appended();
+  test_renamed();
+  test_shared();
+
+  if(failed)
+  {
+    std::printf("FAILED\n");
+    return 1;
+  }
+
+  std::printf("OK\n");
+  return 0;
+}
@@ -1,11 +1,14 @@
+#include <fstream>
+#include <memory_resource>
 #include <sstream>
+#include "corpus.hpp"
 #include "parser.hpp"
 
-int main()
+// asserts that every way of parsing the original input regenerates it exactly,
+// returning the regenerated input
+std::string test_round_trip(const std::string& original)
 {
-  // read the input into a buffer
-  std::stringstream input;
-  input << std::cin.rdbuf();
+  std::stringstream input{original};
 
   // parse the input
   hattip::lexer lex{input};
@@ -19,8 +22,155 @@ int main()
   // assert the regenerated input is identical to the original
   assert(regenerated_input.str() == input.str());
 
+  // parse the input again, this time as views into a contiguous buffer
+  std::string buffer = input.str();
+  hattip::lexer view_lex{std::span<const char>{buffer}};
+  hattip::message_view msg_view;
+  view_lex >> msg_view;
+
+  // assert the views regenerate the original input as well
+  std::stringstream regenerated_from_views;
+  regenerated_from_views << msg_view;
+  assert(regenerated_from_views.str() == input.str());
+
+  // assert the pieces gathered for writev() regenerate the original input as well
+  {
+    hattip::iovec_list iov;
+    serialize(iov, msg);
+    serialize(iov, msg_view);
+
+    std::string gathered;
+    for(std::size_t i = 0; i != iov.size(); ++i)
+    {
+      gathered.append(static_cast<const char*>(iov.data()[i].iov_base), iov.data()[i].iov_len);
+    }
+    assert(gathered == input.str() + input.str());
+  }
+
+  // assert serializing into a buffer of exactly the serialized size regenerates the original input as well
+  {
+    std::string serialized(hattip::serialized_size(msg), '\0');
+    assert(hattip::serialize_into(serialized.data(), msg) == serialized.data() + serialized.size());
+    assert(serialized == input.str());
+    assert(hattip::serialized_size(msg_view) == serialized.size());
+  }
+
+  // parse the input again without exceptions
+  {
+    hattip::message_view unthrown_msg;
+    hattip::parse_result result = hattip::parse(buffer, unthrown_msg);
+    assert(result and result.offset == buffer.size());
+
+    std::stringstream regenerated_without_exceptions;
+    regenerated_without_exceptions << unthrown_msg;
+    assert(regenerated_without_exceptions.str() == input.str());
+  }
+
+  // parse the input again into the same message, reusing its storage
+  {
+    hattip::lexer reuse_lex{std::span<const char>{buffer}};
+    msg.reset();
+    reuse_lex >> msg;
+
+    std::stringstream regenerated_from_reuse;
+    regenerated_from_reuse << msg;
+    assert(regenerated_from_reuse.str() == input.str());
+  }
+
+  // parse the input into an arena, with the default memory resource disabled to prove nothing escapes it
+  {
+    std::pmr::monotonic_buffer_resource arena;
+    std::pmr::memory_resource* previous_default = std::pmr::set_default_resource(std::pmr::null_memory_resource());
+
+    hattip::lexer arena_lex{std::span<const char>{buffer}};
+    hattip::pmr::message arena_msg{&arena};
+    arena_lex >> arena_msg;
+
+    std::pmr::set_default_resource(previous_default);
+
+    std::stringstream regenerated_from_arena;
+    regenerated_from_arena << arena_msg;
+    assert(regenerated_from_arena.str() == input.str());
+  }
+
+  // if the input is a Full-Request, parse it again a byte at a time with the push parser
+  if(auto req = std::get_if<hattip::request>(&msg.body); req and std::holds_alternative<hattip::full_request>(req->body))
+  {
+    hattip::request_parser parser;
+    hattip::parse_status status = hattip::parse_status::need_more;
+    for(char c : buffer)
+    {
+      assert(status == hattip::parse_status::need_more);
+      status = parser.feed(std::span<const char>{&c, 1});
+    }
+
+    // without Content-Length, the Entity-Body ends with the input
+    if(status == hattip::parse_status::need_more)
+    {
+      status = parser.finish();
+    }
+    assert(status == hattip::parse_status::done);
+
+    std::stringstream regenerated_from_chunks;
+    regenerated_from_chunks << parser.get();
+    assert(regenerated_from_chunks.str() == input.str());
+
+    // if the Entity-Body is framed, parse the input pipelined twice from one buffer
+    const hattip::full_request& fr = parser.get();
+    if(hattip::is_chunked(fr.headers) or hattip::content_length(fr.headers) or fr.body.empty())
+    {
+      std::string twice = buffer + buffer;
+      hattip::pipeline<hattip::full_request_view> pipelined{std::span<const char>{twice}};
+      hattip::full_request_view pipelined_msg;
+
+      for(int i = 0; i != 2; ++i)
+      {
+        assert(pipelined.next(pipelined_msg) == buffer.size());
+
+        std::stringstream regenerated_from_pipeline;
+        regenerated_from_pipeline << pipelined_msg;
+        assert(regenerated_from_pipeline.str() == input.str());
+      }
+
+      assert(pipelined.remaining().empty());
+
+      // and again without exceptions
+      hattip::pipeline<hattip::full_request_view> unthrown{std::span<const char>{twice}};
+      unthrown.exceptions(false);
+      assert(unthrown.next(pipelined_msg) == buffer.size() and unthrown.next(pipelined_msg) == buffer.size());
+      assert(unthrown.result() and unthrown.result().offset == twice.size());
+    }
+  }
+
+  return regenerated_input.str();
+}
+
+
+int main(int argc, char** argv)
+{
+  // given a corpus file, e.g. from gen_corpus, test each of its messages
+  if(argc > 1)
+  {
+    std::ifstream file{argv[1], std::ios::binary};
+    std::vector<std::string> messages = hattip::corpus::read(file);
+
+    for(const std::string& message : messages)
+    {
+      test_round_trip(message);
+    }
+
+    std::cout << messages.size() << " messages" << std::endl;
+    std::cout << "OK" << std::endl;
+
+    return 0;
+  }
+
+  // otherwise, test the message on stdin
+  std::stringstream input;
+  input << std::cin.rdbuf();
+
   std::cout << "---Message begins---" << std::endl;
-  std::cout << regenerated_input.str();
+  std::cout << test_round_trip(input.str());
   std::cout << "---Message ends---" << std::endl;
 
   std::cout << "OK" << std::endl;
@@ -0,0 +1,403 @@
+#include <cstdio>
+#include <fstream>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+#include <arpa/inet.h>
+#include <poll.h>
+#include "server.hpp"
+#include "uring_server.hpp"
+
+// serves requests on a loopback port with each server and checks the responses a client
+// receives to pipelined, split, keep-alive, closing, and malformed requests
+
+
+bool failed = false;
+
+
+void expect(const char* server, const char* name, bool ok)
+{
+  failed = failed or not ok;
+  std::printf("%-14s %-48s %s\n", server, name, ok ? "OK" : "FAILED");
+}
+
+
+// answers each request with its Request-URI followed by its Entity-Body, except that
+// "/large" is answered with 32 MiB, more than a socket's send buffer holds
+void echo(const hattip::full_request& request, hattip::full_response& response)
+{
+  if(request.rl.uri == "/large")
+  {
+    response.body.assign(32 << 20, 'x');
+    return;
+  }
+
+  response.body.assign(request.rl.uri);
+  response.body.append(request.body);
+}
+
+
+int connect_to(std::uint16_t port)
+{
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+
+  sockaddr_in address{};
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  address.sin_port = htons(port);
+
+  if(connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == -1)
+  {
+    hattip::throw_system_error("connect");
+  }
+
+  return fd;
+}
+
+
+void send_all(int fd, std::string_view data)
+{
+  while(not data.empty())
+  {
+    ssize_t n = send(fd, data.data(), data.size(), MSG_NOSIGNAL);
+    if(n == -1)
+    {
+      hattip::throw_system_error("send");
+    }
+    data.remove_prefix(n);
+  }
+}
+
+
+// reads until the server closes the connection
+std::string receive_all(int fd)
+{
+  std::string result;
+  char buffer[4096];
+
+  for(ssize_t n; (n = read(fd, buffer, sizeof(buffer))) > 0;)
+  {
+    result.append(buffer, n);
+  }
+
+  return result;
+}
+
+
+// reads until one complete response has arrived
+hattip::full_response receive_response(int fd)
+{
+  hattip::response_parser parser;
+  parser.set_unframed_body(hattip::unframed_body::http_1_1);
+
+  char buffer[4096];
+  while(parser.status() == hattip::parse_status::need_more)
+  {
+    ssize_t n = read(fd, buffer, sizeof(buffer));
+    if(n <= 0)
+    {
+      break;
+    }
+    parser.feed(std::span<const char>{buffer, static_cast<std::size_t>(n)});
+  }
+
+  return parser.get();
+}
+
+
+std::string repeat(std::string_view s, std::size_t n)
+{
+  std::string result;
+  for(std::size_t i = 0; i != n; ++i)
+  {
+    result += s;
+  }
+
+  return result;
+}
+
+
+// the memory this process has resident
+std::size_t resident_bytes()
+{
+  std::size_t size = 0, resident = 0;
+  std::ifstream{"/proc/self/statm"} >> size >> resident;
+  return resident * sysconf(_SC_PAGESIZE);
+}
+
+
+// sends pipelined requests without reading their responses until the server stops taking
+// them, returning how much it took, or limit if it never stopped
+std::size_t flood(int fd, std::size_t limit)
+{
+  const std::string requests = repeat("GET /a HTTP/1.1\r\n\r\n", 4096);
+  std::size_t total = 0;
+
+  while(total < limit)
+  {
+    ssize_t n = send(fd, requests.data(), requests.size(), MSG_NOSIGNAL | MSG_DONTWAIT);
+    if(n > 0)
+    {
+      total += n;
+      continue;
+    }
+
+    if(n == -1 and errno != EAGAIN)
+    {
+      hattip::throw_system_error("send");
+    }
+
+    // the server has stopped taking requests if they stay unsent for a while
+    pollfd writable{fd, POLLOUT, 0};
+    if(poll(&writable, 1, 500) == 0)
+    {
+      break;
+    }
+  }
+
+  return total;
+}
+
+
+// splits output into the responses it holds, formatting each as "status body"
+std::vector<std::string> responses(const std::string& output)
+{
+  std::vector<std::string> result;
+
+  hattip::pipeline<hattip::full_response_view> messages{std::span<const char>{output}};
+  hattip::full_response_view msg;
+  while(messages.next(msg) != 0)
+  {
+    result.push_back(std::to_string(msg.sl.code.number) + " " + std::string{msg.body});
+  }
+
+  return result;
+}
+
+
+template<class Server>
+void test(const char* server_name)
+{
+  int listener = hattip::open_listener(0);
+  std::uint16_t port = hattip::local_port(listener);
+
+  Server server{listener, echo};
+  std::thread thread{[&]{ server.run(); }};
+
+  std::string get = "GET /a HTTP/1.1\r\nHost: localhost\r\n\r\n";
+  std::string post = "POST /b HTTP/1.1\r\nContent-Length: 5\r\n\r\nhello";
+  std::string chunked = "POST /c HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n3\r\nabc\r\n0\r\n\r\n";
+
+  {
+    int fd = connect_to(port);
+    send_all(fd, get + post + chunked + get);
+    shutdown(fd, SHUT_WR);
+
+    std::vector<std::string> expected = {"200 /a", "200 /bhello", "200 /c3\r\nabc\r\n0\r\n\r\n", "200 /a"};
+    expect(server_name, "pipelined requests", responses(receive_all(fd)) == expected);
+    close(fd);
+  }
+
+  {
+    int fd = connect_to(port);
+    std::string input = get + post;
+    for(char c : input)
+    {
+      send_all(fd, std::string_view{&c, 1});
+    }
+    shutdown(fd, SHUT_WR);
+
+    std::vector<std::string> expected = {"200 /a", "200 /bhello"};
+    expect(server_name, "requests split into single characters", responses(receive_all(fd)) == expected);
+    close(fd);
+  }
+
+  {
+    int fd = connect_to(port);
+
+    bool ok = true;
+    for(int i = 0; i != 3; ++i)
+    {
+      send_all(fd, post);
+      hattip::full_response response = receive_response(fd);
+      ok = ok and response.body == "/bhello" and not response.headers.find("Connection");
+    }
+    expect(server_name, "keep-alive connection", ok);
+    close(fd);
+  }
+
+  {
+    int fd = connect_to(port);
+    send_all(fd, "GET /a HTTP/1.1\r\nConnection: close\r\n\r\n" + get);
+
+    // the server closes the connection without answering the request after Connection: close
+    std::vector<std::string> expected = {"200 /a"};
+    expect(server_name, "Connection: close", responses(receive_all(fd)) == expected);
+    close(fd);
+  }
+
+  {
+    int fd = connect_to(port);
+    send_all(fd, "GET /a HTTP/1.0\r\n\r\n");
+
+    std::vector<std::string> expected = {"200 /a"};
+    expect(server_name, "HTTP/1.0 without keep-alive", responses(receive_all(fd)) == expected);
+    close(fd);
+  }
+
+  {
+    int fd = connect_to(port);
+    send_all(fd, "GET /large HTTP/1.0\r\n\r\n");
+
+    // the server closes the connection once the last of many writes completes
+    std::vector<std::string> expected = {"200 " + std::string(32 << 20, 'x')};
+    expect(server_name, "closing after a response of many writes", responses(receive_all(fd)) == expected);
+    close(fd);
+  }
+
+  {
+    int fd = connect_to(port);
+    std::string large = "GET /large HTTP/1.1\r\n\r\n";
+    send_all(fd, large + large + large + large + "GET /a HTTP/1.1\r\nConnection: close\r\n\r\n");
+
+    // the server stops reading requests while the responses back up, and resumes as they drain
+    std::vector<std::string> expected(4, "200 " + std::string(32 << 20, 'x'));
+    expected.push_back("200 /a");
+    expect(server_name, "pipelined requests for large responses", responses(receive_all(fd)) == expected);
+    close(fd);
+  }
+
+  {
+    int fd = connect_to(port);
+    send_all(fd, get + "GET /a HTTP/1.1\r\nHost localhost\r\n\r\n" + get);
+
+    std::vector<std::string> expected = {"200 /a", "400 "};
+    expect(server_name, "malformed request", responses(receive_all(fd)) == expected);
+    close(fd);
+  }
+
+  {
+    int fd = connect_to(port);
+    send_all(fd, "POST /b HTTP/1.1\r\nContent-Length: 5, 5\r\nContent-Length: 5\r\n\r\nhello");
+    send_all(fd, "POST /b HTTP/1.1\r\nContent-Length: 0\r\nContent-Length: 5\r\n\r\nhello" + get);
+
+    // repeated Content-Lengths must agree, else the server can't tell where the next request starts
+    std::vector<std::string> expected = {"200 /bhello", "400 "};
+    expect(server_name, "differing Content-Lengths", responses(receive_all(fd)) == expected);
+    close(fd);
+  }
+
+  // a client can't make the server buffer headers without limit
+  std::pair<const char*, std::string> oversized_headers[] = {
+    {"header line too long", "X-Long: " + std::string(8 * 1024, 'a') + "\r\n"},
+    {"too many headers", repeat("X-Many: a\r\n", 101)}
+  };
+
+  for(auto& [name, headers] : oversized_headers)
+  {
+    int fd = connect_to(port);
+    send_all(fd, "GET /a HTTP/1.1\r\n" + headers + "\r\n");
+
+    std::vector<std::string> expected = {"400 "};
+    expect(server_name, name, responses(receive_all(fd)) == expected);
+    close(fd);
+  }
+
+  // framing an Entity-Body ambiguously would let a request be smuggled past a proxy
+  std::pair<const char*, std::string> ambiguous_framings[] = {
+    {"Transfer-Encoding with Content-Length", "Transfer-Encoding: chunked\r\nContent-Length: 3\r\n"},
+    {"Transfer-Encoding not ending with chunked", "Transfer-Encoding: chunked, gzip\r\n"}
+  };
+
+  for(auto& [name, framing] : ambiguous_framings)
+  {
+    int fd = connect_to(port);
+    send_all(fd, "POST /b HTTP/1.1\r\n" + framing + "\r\n0\r\n\r\n" + get);
+
+    std::vector<std::string> expected = {"400 "};
+    expect(server_name, name, responses(receive_all(fd)) == expected);
+    close(fd);
+  }
+
+  // a client that sends requests without reading the responses can't make the server buffer
+  // them without limit
+  {
+    std::size_t before = resident_bytes();
+
+    int fd = connect_to(port);
+    std::size_t limit = 256 << 20;
+    bool stopped = flood(fd, limit) < limit;
+    bool bounded = resident_bytes() < before + (64 << 20);
+    close(fd);
+
+    fd = connect_to(port);
+    send_all(fd, "GET /a HTTP/1.1\r\nConnection: close\r\n\r\n");
+    std::vector<std::string> expected = {"200 /a"};
+    expect(server_name, "flood without reading stays bounded", stopped and bounded and responses(receive_all(fd)) == expected);
+    close(fd);
+  }
+
+  server.stop();
+  thread.join();
+}
+
+
+// checks that every shard of a sharded_server answers the connections the kernel gives it,
+// and that the kernel spreads them over more than one shard
+template<class Server>
+void test_sharded(const char* server_name)
+{
+  // each shard runs on its own thread, so the threads that answer tell the shards apart
+  std::mutex mutex;
+  std::set<std::thread::id> shards;
+
+  auto handle = [&](const hattip::full_request& request, hattip::full_response& response)
+  {
+    {
+      std::lock_guard lock{mutex};
+      shards.insert(std::this_thread::get_id());
+    }
+
+    echo(request, response);
+  };
+
+  hattip::sharded_server<Server> server{0, handle, 4};
+  std::thread thread{[&]{ server.run(); }};
+
+  bool ok = true;
+  for(int i = 0; i != 32; ++i)
+  {
+    int fd = connect_to(server.port());
+    send_all(fd, "GET /" + std::to_string(i) + " HTTP/1.1\r\nConnection: close\r\n\r\n");
+
+    std::vector<std::string> expected = {"200 /" + std::to_string(i)};
+    ok = ok and responses(receive_all(fd)) == expected;
+    close(fd);
+  }
+  expect(server_name, "32 connections to 4 shards", ok);
+  expect(server_name, "connections spread over shards", shards.size() > 1);
+
+  server.stop();
+  thread.join();
+}
+
+
+int main()
+{
+  test<hattip::epoll_server>("epoll_server");
+  test<hattip::uring_server>("uring_server");
+  test_sharded<hattip::epoll_server>("epoll_server");
+  test_sharded<hattip::uring_server>("uring_server");
+
+  if(failed)
+  {
+    std::printf("FAILED\n");
+    return 1;
+  }
+
+  std::printf("OK\n");
+  return 0;
+}
+
@@ -0,0 +1,683 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include "server.hpp"
+
+namespace hattip
+{
+
+
+// uring is a minimal io_uring: a submission queue and a completion queue shared with the
+// kernel, set up and mapped with raw system calls so that it needs no liburing
+struct uring
+{
+  explicit uring(unsigned entries)
+  {
+    // a single-issuer ring belongs to the thread that enables it, so it starts disabled
+    io_uring_params params{};
+    params.flags = IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN | IORING_SETUP_R_DISABLED;
+
+    fd_ = syscall(__NR_io_uring_setup, entries, &params);
+    if(fd_ == -1 and errno == EINVAL)
+    {
+      // kernels before 6.1 lack these flags, which merely spare the kernel some work
+      params = {};
+      fd_ = syscall(__NR_io_uring_setup, entries, &params);
+    }
+
+    disabled_ = params.flags & IORING_SETUP_R_DISABLED;
+
+    if(fd_ == -1)
+    {
+      throw_system_error("io_uring_setup");
+    }
+
+    sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+
+    bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if(single_mmap)
+    {
+      sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+    }
+
+    sq_ring_ = map(sq_ring_size_, IORING_OFF_SQ_RING);
+    cq_ring_ = single_mmap ? sq_ring_ : map(cq_ring_size_, IORING_OFF_CQ_RING);
+    sqes_ = static_cast<io_uring_sqe*>(map(sqes_size_, IORING_OFF_SQES));
+
+    sq_head_ = at<unsigned>(sq_ring_, params.sq_off.head);
+    sq_tail_ = at<unsigned>(sq_ring_, params.sq_off.tail);
+    sq_mask_ = *at<unsigned>(sq_ring_, params.sq_off.ring_mask);
+    sq_entries_ = params.sq_entries;
+
+    cq_head_ = at<unsigned>(cq_ring_, params.cq_off.head);
+    cq_tail_ = at<unsigned>(cq_ring_, params.cq_off.tail);
+    cq_mask_ = *at<unsigned>(cq_ring_, params.cq_off.ring_mask);
+    cqes_ = at<io_uring_cqe>(cq_ring_, params.cq_off.cqes);
+
+    // the kernel finds each submission through the array, which we fill once with the identity
+    unsigned* array = at<unsigned>(sq_ring_, params.sq_off.array);
+    for(unsigned i = 0; i != sq_entries_; ++i)
+    {
+      array[i] = i;
+    }
+
+    sqe_tail_ = *sq_tail_;
+  }
+
+  ~uring()
+  {
+    close(fd_);
+    munmap(sqes_, sqes_size_);
+    if(cq_ring_ != sq_ring_)
+    {
+      munmap(cq_ring_, cq_ring_size_);
+    }
+    munmap(sq_ring_, sq_ring_size_);
+  }
+
+  uring(const uring&) = delete;
+
+  int fd() const
+  {
+    return fd_;
+  }
+
+  // makes the calling thread the only one to submit to the ring, and enables it
+  void enable()
+  {
+    if(disabled_ and syscall(__NR_io_uring_register, fd_, IORING_REGISTER_ENABLE_RINGS, nullptr, 0) == -1)
+    {
+      throw_system_error("io_uring_register(IORING_REGISTER_ENABLE_RINGS)");
+    }
+
+    disabled_ = false;
+  }
+
+  // returns a cleared submission queue entry to fill in, submitting those queued so far if
+  // the submission queue is full
+  //
+  // throws if the kernel takes none of them, as it may while it lacks memory or, before 5.19,
+  // while completions overflow, since each entry it hasn't taken is still in use
+  io_uring_sqe& next_sqe()
+  {
+    while(sqe_tail_ - std::atomic_ref{*sq_head_}.load(std::memory_order_acquire) == sq_entries_)
+    {
+      long taken = enter(0);
+      if(taken == -1 and errno == EINTR)
+      {
+        continue;
+      }
+
+      if(taken <= 0)
+      {
+        errno = taken == 0 ? EBUSY : errno;
+        throw_system_error("io_uring_enter");
+      }
+    }
+
+    io_uring_sqe& sqe = sqes_[sqe_tail_ & sq_mask_];
+    ++sqe_tail_;
+
+    sqe = {};
+    return sqe;
+  }
+
+  // submits the queued entries, and waits until at least wait_for completions are available
+  //
+  // entries the kernel doesn't take for now stay queued for the next call
+  void submit(unsigned wait_for)
+  {
+    if(enter(wait_for) == -1 and errno != EINTR and errno != EAGAIN and errno != EBUSY)
+    {
+      throw_system_error("io_uring_enter");
+    }
+  }
+
+  // calls f with each available completion queue entry, then hands them back to the kernel
+  template<class F>
+  void for_each_completion(F f)
+  {
+    unsigned head = *cq_head_;
+    unsigned tail = std::atomic_ref{*cq_tail_}.load(std::memory_order_acquire);
+
+    for(; head != tail; ++head)
+    {
+      f(cqes_[head & cq_mask_]);
+    }
+
+    std::atomic_ref{*cq_head_}.store(head, std::memory_order_release);
+  }
+
+  private:
+    // publishes the queued entries to the kernel and submits them, returning how many it took,
+    // or -1 with errno set
+    long enter(unsigned wait_for)
+    {
+      std::atomic_ref{*sq_tail_}.store(sqe_tail_, std::memory_order_release);
+      unsigned queued = sqe_tail_ - std::atomic_ref{*sq_head_}.load(std::memory_order_acquire);
+
+      // GETEVENTS also runs the completion work a DEFER_TASKRUN ring defers until we ask
+      return syscall(__NR_io_uring_enter, fd_, queued, wait_for, IORING_ENTER_GETEVENTS, nullptr, 0);
+    }
+
+    void* map(std::size_t size, std::uint64_t offset)
+    {
+      void* result = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, offset);
+      if(result == MAP_FAILED)
+      {
+        throw_system_error("mmap(io_uring)");
+      }
+
+      return result;
+    }
+
+    template<class T>
+    static T* at(void* ring, std::uint32_t offset)
+    {
+      return reinterpret_cast<T*>(static_cast<char*>(ring) + offset);
+    }
+
+    int fd_;
+    bool disabled_;
+
+    void* sq_ring_;
+    std::size_t sq_ring_size_;
+    unsigned* sq_head_;
+    unsigned* sq_tail_;
+    unsigned sq_mask_;
+    unsigned sq_entries_;
+    io_uring_sqe* sqes_;
+    std::size_t sqes_size_;
+
+    // the tail of the entries we've queued, published to the kernel by submit()
+    unsigned sqe_tail_;
+
+    void* cq_ring_;
+    std::size_t cq_ring_size_;
+    unsigned* cq_head_;
+    unsigned* cq_tail_;
+    unsigned cq_mask_;
+    io_uring_cqe* cqes_;
+};
+
+
+// provided_buffers is a group of equally sized receive buffers provided to a uring, from which
+// the kernel picks one as data arrives, instead of each receive naming a buffer up front
+//
+// a connection thus ties up no buffer while it is idle
+//
+// buffers are provided with IORING_OP_PROVIDE_BUFFERS rather than a buffer ring registered with
+// IORING_REGISTER_PBUF_RING, which some kernels accept yet never hand a buffer out of. providing
+// a buffer costs a submission queue entry instead of a store to the ring, but no system call
+struct provided_buffers
+{
+  // allocates count buffers of size characters each for group, leaving their memory untouched
+  // until the kernel receives into them
+  provided_buffers(std::uint16_t group, std::uint16_t count, std::uint32_t size)
+    : group_{group},
+      count_{count},
+      size_{size},
+      storage_{std::make_unique_for_overwrite<char[]>(std::size_t{count} * size)}
+  {}
+
+  provided_buffers(const provided_buffers&) = delete;
+
+  // provides every buffer to the kernel
+  void provide_all(uring& ring)
+  {
+    provide(ring, 0, count_);
+  }
+
+  // the first n characters the kernel received into buffer id
+  std::span<const char> get(std::uint16_t id, std::size_t n) const
+  {
+    return {storage_.get() + std::size_t{id} * size_, n};
+  }
+
+  // provides buffer id to the kernel again
+  void recycle(uring& ring, std::uint16_t id)
+  {
+    provide(ring, id, 1);
+  }
+
+  private:
+    void provide(uring& ring, std::uint16_t first, std::uint16_t n)
+    {
+      io_uring_sqe& sqe = ring.next_sqe();
+      sqe.opcode = IORING_OP_PROVIDE_BUFFERS;
+      sqe.fd = n;
+      sqe.addr = reinterpret_cast<std::uint64_t>(storage_.get() + std::size_t{first} * size_);
+      sqe.len = size_;
+      sqe.off = first;
+      sqe.buf_group = group_;
+
+      // only a failure, whose user_data is 0, completes
+      sqe.flags = IOSQE_CQE_SKIP_SUCCESS;
+    }
+
+    std::uint16_t group_;
+    std::uint16_t count_;
+    std::uint32_t size_;
+    std::unique_ptr<char[]> storage_;
+};
+
+
+// uring_server serves the connections accepted from a listening socket on a single thread,
+// with io_uring
+//
+// unlike epoll_server, it makes no system call per socket operation: a single multishot accept
+// yields every connection, a single multishot receive per connection yields its input in
+// buffers the kernel picks from a shared group, and each batch of responses is sent with one
+// send, linked to a shutdown when the connection should close after it. submissions and
+// completions for all connections are exchanged with one io_uring_enter per loop iteration
+struct uring_server
+{
+  // serves the connections accepted from listener, which the server closes when it is destroyed
+  //
+  // connections receive into num_buffers buffers of buffer_size characters each, shared among
+  // them, which bounds how much input the server holds before parsing it
+  uring_server(int listener, handler handle, unsigned entries = 4096, std::uint16_t num_buffers = 512, std::uint32_t buffer_size = 16 * 1024)
+    : listener_{listener},
+      wake_fd_{eventfd(0, EFD_CLOEXEC)},
+      handle_{std::move(handle)},
+      buffers_{buffer_group, num_buffers, buffer_size},
+      ring_{entries}
+  {
+    if(wake_fd_ == -1)
+    {
+      throw_system_error("eventfd");
+    }
+  }
+
+  ~uring_server()
+  {
+    close(wake_fd_);
+    close(listener_);
+  }
+
+  uring_server(const uring_server&) = delete;
+
+  // serves connections on the calling thread until stop() is called
+  inline void run()
+  {
+    ring_.enable();
+    buffers_.provide_all(ring_);
+    accept();
+    wait_for_wake();
+
+    while(not stopping_.load(std::memory_order_relaxed))
+    {
+      ring_.submit(1);
+      ring_.for_each_completion([this](const io_uring_cqe& cqe)
+      {
+        complete(cqe);
+      });
+    }
+  }
+
+  // makes run() return; safe to call from any thread, or from a signal handler
+  void stop()
+  {
+    stopping_.store(true, std::memory_order_relaxed);
+
+    std::uint64_t one = 1;
+    [[maybe_unused]] ssize_t result = write(wake_fd_, &one, sizeof(one));
+  }
+
+  private:
+    static constexpr std::uint16_t buffer_group = 0;
+
+    // the operation a completion belongs to, kept in the low byte of its user_data,
+    // above which is the connection's socket
+    enum operation : std::uint8_t
+    {
+      // provided_buffers leaves user_data 0
+      provide_operation,
+      accept_operation,
+      accept_retry_operation,
+      receive_operation,
+      cancel_receive_operation,
+      send_operation,
+      shutdown_operation,
+      wake_operation
+    };
+
+    static std::uint64_t user_data(int fd, operation op)
+    {
+      return (std::uint64_t(fd) << 8) | op;
+    }
+
+    struct client
+    {
+      explicit client(int fd)
+        : conn{fd}
+      {}
+
+      connection conn;
+
+      // the output being sent, swapped with conn.output so that responses queued meanwhile
+      // don't move it
+      std::string sending;
+      std::size_t sent = 0;
+
+      // the output taken from conn.output but not yet sent
+      std::size_t unsent() const
+      {
+        return sending.size() - sent;
+      }
+
+      bool receiving = false;
+      bool cancelling_receive = false;
+      bool send_in_flight = false;
+      bool shutting_down = false;
+      bool closing = false;
+
+      // the number of operations whose final completion has yet to arrive
+      unsigned in_flight = 0;
+    };
+
+    inline void accept()
+    {
+      io_uring_sqe& sqe = ring_.next_sqe();
+      sqe.opcode = IORING_OP_ACCEPT;
+      sqe.fd = listener_;
+      sqe.ioprio = IORING_ACCEPT_MULTISHOT;
+      sqe.accept_flags = SOCK_CLOEXEC;
+      sqe.user_data = user_data(listener_, accept_operation);
+    }
+
+    // accepts again after a while, e.g. once connections have closed and freed descriptors
+    inline void accept_later()
+    {
+      io_uring_sqe& sqe = ring_.next_sqe();
+      sqe.opcode = IORING_OP_TIMEOUT;
+      sqe.addr = reinterpret_cast<std::uint64_t>(&accept_retry_delay_);
+      sqe.len = 1;
+      sqe.user_data = user_data(listener_, accept_retry_operation);
+    }
+
+    inline void wait_for_wake()
+    {
+      io_uring_sqe& sqe = ring_.next_sqe();
+      sqe.opcode = IORING_OP_READ;
+      sqe.fd = wake_fd_;
+      sqe.addr = reinterpret_cast<std::uint64_t>(&wake_count_);
+      sqe.len = sizeof(wake_count_);
+      sqe.user_data = user_data(wake_fd_, wake_operation);
+    }
+
+    inline void receive(client& c)
+    {
+      io_uring_sqe& sqe = ring_.next_sqe();
+      sqe.opcode = IORING_OP_RECV;
+      sqe.fd = c.conn.fd;
+      sqe.ioprio = IORING_RECV_MULTISHOT;
+      sqe.flags = IOSQE_BUFFER_SELECT;
+      sqe.buf_group = buffer_group;
+      sqe.user_data = user_data(c.conn.fd, receive_operation);
+
+      c.receiving = true;
+      ++c.in_flight;
+    }
+
+    // stops the multishot receive of a connection whose requests back up, leaving further input
+    // in the socket until the output drains
+    inline void cancel_receive(client& c)
+    {
+      io_uring_sqe& sqe = ring_.next_sqe();
+      sqe.opcode = IORING_OP_ASYNC_CANCEL;
+      sqe.addr = user_data(c.conn.fd, receive_operation);
+      sqe.user_data = user_data(c.conn.fd, cancel_receive_operation);
+
+      // the receive's final completion tells us it's cancelled, so only a failure completes
+      sqe.flags = IOSQE_CQE_SKIP_SUCCESS;
+
+      c.cancelling_receive = true;
+    }
+
+    // sends whatever output is pending, then shuts the connection down if it's closing,
+    // and releases it once nothing remains in flight
+    inline void flush(client& c)
+    {
+      if(c.send_in_flight)
+      {
+        return;
+      }
+
+      if(c.sending.empty())
+      {
+        std::swap(c.sending, c.conn.output);
+      }
+
+      bool shut_down = c.closing and not c.shutting_down and c.receiving and c.conn.output.empty();
+
+      if(c.sent != c.sending.size())
+      {
+        io_uring_sqe& sqe = ring_.next_sqe();
+        sqe.opcode = IORING_OP_SEND;
+        sqe.fd = c.conn.fd;
+        sqe.addr = reinterpret_cast<std::uint64_t>(c.sending.data() + c.sent);
+        sqe.len = c.sending.size() - c.sent;
+        sqe.msg_flags = MSG_NOSIGNAL | MSG_WAITALL;
+        sqe.user_data = user_data(c.conn.fd, send_operation);
+
+        // the shutdown runs only once the send succeeds in full
+        if(shut_down)
+        {
+          sqe.flags = IOSQE_IO_LINK;
+        }
+
+        c.send_in_flight = true;
+        ++c.in_flight;
+      }
+
+      if(shut_down)
+      {
+        // shutting down ends the multishot receive, whose final completion then arrives
+        io_uring_sqe& sqe = ring_.next_sqe();
+        sqe.opcode = IORING_OP_SHUTDOWN;
+        sqe.fd = c.conn.fd;
+        sqe.len = SHUT_RDWR;
+        sqe.user_data = user_data(c.conn.fd, shutdown_operation);
+
+        c.shutting_down = true;
+        ++c.in_flight;
+      }
+
+      if(c.closing and c.in_flight == 0)
+      {
+        // destroying the connection closes its socket
+        clients_[c.conn.fd].reset();
+      }
+    }
+
+    inline void complete(const io_uring_cqe& cqe)
+    {
+      auto op = static_cast<operation>(cqe.user_data & 0xff);
+      int fd = cqe.user_data >> 8;
+      bool more = cqe.flags & IORING_CQE_F_MORE;
+
+      if(op == accept_operation)
+      {
+        if(cqe.res >= 0)
+        {
+          int one = 1;
+          setsockopt(cqe.res, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+          if(clients_.size() <= std::size_t(cqe.res))
+          {
+            clients_.resize(cqe.res + 1);
+          }
+
+          clients_[cqe.res] = std::make_unique<client>(cqe.res);
+          receive(*clients_[cqe.res]);
+        }
+
+        // the multishot accept ends on errors; only those concerning the connection at hand
+        // allow accepting again at once, since the others would fail again straight away
+        if(not more)
+        {
+          switch(-cqe.res)
+          {
+            case EMFILE:
+            case ENFILE:
+            case ENOBUFS:
+            case ENOMEM:
+            {
+              accept_later();
+              break;
+            }
+
+            case EBADF:
+            case EFAULT:
+            case EINVAL:
+            case ENOTSOCK:
+            case EOPNOTSUPP:
+            {
+              errno = -cqe.res;
+              throw_system_error("io_uring(IORING_OP_ACCEPT)");
+            }
+
+            default:
+            {
+              accept();
+              break;
+            }
+          }
+        }
+
+        return;
+      }
+
+      if(op == accept_retry_operation)
+      {
+        accept();
+        return;
+      }
+
+      if(op == wake_operation or op == cancel_receive_operation)
+      {
+        // a cancellation fails only when the receive has already ended, and its client may
+        // be gone
+        return;
+      }
+
+      if(op == provide_operation)
+      {
+        // a buffer the kernel wouldn't take back would be lost to every connection
+        errno = -cqe.res;
+        throw_system_error("io_uring(IORING_OP_PROVIDE_BUFFERS)");
+      }
+
+      client& c = *clients_[fd];
+
+      if(op == receive_operation)
+      {
+        if(cqe.res > 0)
+        {
+          auto id = static_cast<std::uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+
+          // the parser copies what it keeps, so the buffer goes straight back to the kernel
+          if(not c.conn.receive(buffers_.get(id, cqe.res), handle_, c.unsent()))
+          {
+            c.closing = true;
+          }
+
+          buffers_.recycle(ring_, id);
+        }
+        else if(cqe.res != -ENOBUFS and cqe.res != -ECANCELED)
+        {
+          // the client closed its end, or the connection failed
+          c.closing = true;
+        }
+
+        if(not more)
+        {
+          c.receiving = false;
+          c.cancelling_receive = false;
+          --c.in_flight;
+
+          // the receive also ends when the kernel runs out of buffers, until we recycle some,
+          // and when we cancel it, until the output drains
+          if(not c.closing and not c.conn.backlogged())
+          {
+            receive(c);
+          }
+        }
+        else if(c.conn.backlogged() and not c.cancelling_receive)
+        {
+          // a receive left running would feed the parser input without limit
+          cancel_receive(c);
+        }
+      }
+      else if(op == send_operation)
+      {
+        c.send_in_flight = false;
+        --c.in_flight;
+
+        if(cqe.res < 0)
+        {
+          c.closing = true;
+          c.sending.clear();
+          c.conn.output.clear();
+          c.sent = 0;
+        }
+        else if((c.sent += cqe.res) == c.sending.size())
+        {
+          c.sending.clear();
+          c.sent = 0;
+        }
+
+        // answer the requests held back while the output backed up, now that some has drained,
+        // and receive again once they're all answered
+        if(c.conn.backlogged() and not c.conn.dispatch(handle_, c.unsent()))
+        {
+          c.closing = true;
+        }
+
+        if(not c.closing and not c.receiving and not c.conn.backlogged())
+        {
+          receive(c);
+        }
+      }
+      else if(op == shutdown_operation)
+      {
+        --c.in_flight;
+
+        // a short send cancels its linked shutdown, which flush() retries after the rest
+        if(cqe.res == -ECANCELED)
+        {
+          c.shutting_down = false;
+        }
+      }
+
+      flush(c);
+    }
+
+    int listener_;
+    int wake_fd_;
+    std::uint64_t wake_count_ = 0;
+    __kernel_timespec accept_retry_delay_{0, 100'000'000};
+    handler handle_;
+    provided_buffers buffers_;
+
+    // clients indexed by socket
+    std::vector<std::unique_ptr<client>> clients_;
+    std::atomic<bool> stopping_{false};
+
+    // declared last so that it's destroyed first, closing the ring and with it the operations
+    // in flight before the buffers, counter, and output they refer to are freed
+    uring ring_;
+};
+
+
+} // end hattip
+